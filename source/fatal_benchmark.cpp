@@ -0,0 +1,919 @@
+/*
+ * Copyright (c) Atmosphère-NX
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <stratosphere.hpp>
+#include "fatal_benchmark.hpp"
+#include "fatal_font.hpp"
+#include "fatal_font_rasterizer.hpp"
+
+namespace ams::fatal::srv {
+
+    namespace {
+
+        /* The longest block of proportional text on the fatal screen. */
+        constexpr const char SupportParagraph[] = "An error has occured.\n\n"
+                                                  "Please press the POWER Button to restart the console normally, or a VOL button\n"
+                                                  "to reboot to a payload (or RCM, if none is present). If you are unable to\n"
+                                                  "restart the console, hold the POWER Button for 12 seconds to turn the console off.\n\n"
+                                                  "If the problem persists, refer to the Nintendo Support Website.\n"
+                                                  "support.nintendo.com/switch/error\n";
+
+        constexpr size_t KerningIterations = 2000;
+
+        constexpr u16 BlendVerifyColors[] = { 0xFFFF, 0x0000, 0x39C9, 0xF800, 0x07E0, 0x001F, 0x8410, 0x1234, 0xFEDC };
+        constexpr size_t BlendSpanWidths[] = { 12, 1280 };
+        constexpr size_t BlendPixelsPerRun = 16 * 1024 * 1024;
+
+        constexpr float TextFontSizes[] = { 14.0f, 16.0f, 18.0f, 20.0f, 24.0f };
+        constexpr u32 TextFramebufferWidth = 1280;
+        constexpr u32 TextFramebufferHeight = 720;
+        constexpr u32 TextMargin = 64;
+        constexpr size_t TextIterations = 50;
+
+        constexpr const char SubpixelLine[] = "restart the console, hold the POWER Button for 12 seconds to turn the console off.";
+
+        /* Codepoint ranges for glyph lookup: Latin, general punctuation and symbols, and a plane the fonts don't cover at all. */
+        constexpr std::pair<u32, u32> GlyphLookupRanges[] = { { 0x0000, 0x0600 }, { 0x2000, 0x2800 }, { 0x1F000, 0x1F100 } };
+        constexpr size_t GlyphLookupIterations = 20;
+
+        /* Printable ASCII and Latin-1, which the standard font covers. */
+        constexpr size_t RasterizerCodePointCount = (0x7F - 0x21) + (0x100 - 0xA1);
+        constexpr size_t RasterizerIterations = 20;
+
+        constexpr u32 GetRasterizerCodePoint(size_t index) {
+            return index < 0x7F - 0x21 ? 0x21 + index : 0xA1 + (index - (0x7F - 0x21));
+        }
+
+        constexpr const char *GetRasterizerName(font::RasterizerVersion version) {
+            switch (version) {
+                case font::RasterizerVersion_1:          return "v1";
+                case font::RasterizerVersion_2:          return "v2";
+                case font::RasterizerVersion_FixedPoint: return "fixed";
+                default:                                 return "?";
+            }
+        }
+
+        /* Each rasterizer against the one before it: version 2 replaced version 1, so their difference is only reported, but the fixed point rasterizer must match version 2. */
+        struct RasterizerComparison {
+            font::RasterizerVersion reference;
+            font::RasterizerVersion candidate;
+            bool checked;
+        };
+
+        constexpr RasterizerComparison RasterizerComparisons[] = {
+            { font::RasterizerVersion_1, font::RasterizerVersion_2,          false },
+            { font::RasterizerVersion_2, font::RasterizerVersion_FixedPoint, true  },
+        };
+
+        /* Matching allows rounding to land a level of coverage apart, and a few such pixels to show in the text. */
+        constexpr u32 RasterizerMaxGlyphError = 1;
+        constexpr size_t RasterizerMaxTextDifferent = 128;
+
+        /* The bundled fonts are all TrueType, so cubic outlines are checked with a ring of four cubics around a reversed inner ring of four. */
+        constexpr stbtt_vertex MakeOutlineVertex(u8 type, s16 x, s16 y, s16 cx = 0, s16 cy = 0, s16 cx1 = 0, s16 cy1 = 0) {
+            return stbtt_vertex{ .x = x, .y = y, .cx = cx, .cy = cy, .cx1 = cx1, .cy1 = cy1, .type = type, .padding = 0 };
+        }
+
+        constexpr stbtt_vertex CubicOutline[] = {
+            MakeOutlineVertex(STBTT_vmove,  1000,  500),
+            MakeOutlineVertex(STBTT_vcubic,  500, 1000, 1000,  776,  776, 1000),
+            MakeOutlineVertex(STBTT_vcubic,    0,  500,  224, 1000,    0,  776),
+            MakeOutlineVertex(STBTT_vcubic,  500,    0,    0,  224,  224,    0),
+            MakeOutlineVertex(STBTT_vcubic, 1000,  500,  776,    0, 1000,  224),
+            MakeOutlineVertex(STBTT_vmove,   750,  500),
+            MakeOutlineVertex(STBTT_vcubic,  500,  250,  750,  362,  638,  250),
+            MakeOutlineVertex(STBTT_vcubic,  250,  500,  362,  250,  250,  362),
+            MakeOutlineVertex(STBTT_vcubic,  500,  750,  250,  638,  362,  750),
+            MakeOutlineVertex(STBTT_vcubic,  750,  500,  638,  750,  750,  638),
+        };
+        constexpr s32 CubicOutlineSize = 1000;
+
+        /* Scales in 64ths of a pixel per font unit, so that the float and 32.32 scales are both exact. */
+        constexpr s32 CubicOutlineScales[] = { 1, 2, 3, 4 };
+
+        /* Text mixing scripts and symbols, most of which only fallback faces can draw. */
+        constexpr const char FallbackLine[] = "Error 2162-0002 \u2192 \u30a8\u30e9\u30fc \u00b7 \u9519\u8bef \u00b7 \uc624\ub958 \u00b7 \u041e\u0448\u0438\u0431\u043a\u0430 \u2713 \u25b6 \u2605 \u00b7 \u010ce\u0161tina";
+
+        /* Blend tables are too large for the stack, and so are the contexts that hold them. */
+        constinit font::BlendTable g_blend_table = {};
+        constinit util::TypedStorage<font::FontContext> g_benchmark_contexts[2] = {};
+
+        /* Checks that failed, so that a regression fails the run rather than just printing. */
+        constinit size_t g_num_failed_checks = 0;
+
+        const char *CheckResult(bool passed, const char *passed_text, const char *failed_text) {
+            g_num_failed_checks += !passed;
+            return passed ? passed_text : failed_text;
+        }
+
+        s64 GetElapsedNanoSeconds(os::Tick start_tick) {
+            return os::ConvertToTimeSpan(os::GetSystemTick() - start_tick).GetNanoSeconds();
+        }
+
+        float LayoutKerning(const char *str, size_t len) {
+            float pen = 0.0f;
+            for (size_t i = 1; i < len; ++i) {
+                pen += font::GetKerningAdvance(static_cast<u8>(str[i - 1]), static_cast<u8>(str[i]));
+            }
+            return pen;
+        }
+
+        void BenchmarkKerning() {
+            const size_t len = std::strlen(SupportParagraph);
+            const size_t num_pairs = (len - 1) * KerningIterations;
+
+            for (const float font_size : { 16.0f, 14.0f }) {
+                font::SetFontSize(font_size);
+
+                float results[2];
+                s64 elapsed[2];
+                for (size_t i = 0; i < 2; ++i) {
+                    font::SetKerningMatrixEnabled(i != 0);
+
+                    const auto start_tick = os::GetSystemTick();
+                    results[i] = 0.0f;
+                    for (size_t n = 0; n < KerningIterations; ++n) {
+                        results[i] += LayoutKerning(SupportParagraph, len);
+                    }
+                    elapsed[i] = std::max<s64>(GetElapsedNanoSeconds(start_tick), 1);
+                }
+
+                /* Check every pair the matrix holds, not just the paragraph's totals. */
+                size_t num_mismatches = results[0] != results[1];
+                for (u32 first = 0x20; first < 0x7F; ++first) {
+                    for (u32 second = 0x20; second < 0x7F; ++second) {
+                        font::SetKerningMatrixEnabled(false);
+                        const float expected = font::GetKerningAdvance(first, second);
+                        font::SetKerningMatrixEnabled(true);
+                        num_mismatches += font::GetKerningAdvance(first, second) != expected;
+                    }
+                }
+
+                printf("Kerning (size %.0f): stb %.2f Mpairs/s, matrix %.2f Mpairs/s (%.1fx), %zu mismatches over %u pairs%s\n", font_size,
+                       num_pairs * 1000.0 / elapsed[0], num_pairs * 1000.0 / elapsed[1], static_cast<double>(elapsed[0]) / elapsed[1],
+                       num_mismatches, (0x7F - 0x20) * (0x7F - 0x20), CheckResult(num_mismatches == 0, "", " (FAILED)"));
+            }
+
+            font::SetKerningMatrixEnabled(true);
+        }
+
+        bool VerifyBlendKernel(font::BlendSpanFunction blend_span, u16 *dst, u16 *expected, u8 *coverage) {
+            /* Exhaustively check every background and alpha value for a handful of colors, against the per-pixel reference. */
+            constexpr size_t NumBackgrounds = 0x10000;
+            for (const u16 color : BlendVerifyColors) {
+                font::BuildBlendTable(std::addressof(g_blend_table), color);
+
+                for (u32 alpha = 0; alpha <= 0xFF; ++alpha) {
+                    for (size_t i = 0; i < NumBackgrounds; ++i) {
+                        dst[i]      = static_cast<u16>(i);
+                        expected[i] = font::BlendPixel(color, static_cast<u16>(i), alpha);
+                    }
+                    std::memset(coverage, alpha, NumBackgrounds);
+
+                    /* Use an odd length, so that the kernel's tail handling is exercised too. */
+                    blend_span(dst, coverage, NumBackgrounds - 1, g_blend_table);
+                    blend_span(dst + NumBackgrounds - 1, coverage + NumBackgrounds - 1, 1, g_blend_table);
+
+                    if (std::memcmp(dst, expected, NumBackgrounds * sizeof(u16)) != 0) {
+                        return false;
+                    }
+                }
+            }
+
+            return true;
+        }
+
+        void BenchmarkBlend() {
+            constexpr size_t BufferSize = 0x10000;
+            u16 *dst      = static_cast<u16 *>(std::malloc(BufferSize * sizeof(u16)));
+            u16 *expected = static_cast<u16 *>(std::malloc(BufferSize * sizeof(u16)));
+            u8 *coverage  = static_cast<u8 *>(std::malloc(BufferSize));
+            AMS_ABORT_UNLESS(dst != nullptr && expected != nullptr && coverage != nullptr);
+            ON_SCOPE_EXIT { std::free(dst); std::free(expected); std::free(coverage); };
+
+            for (size_t k = 0; k < font::BlendKernel_Count; ++k) {
+                const auto kernel = static_cast<font::BlendKernel>(k);
+                if (!font::IsBlendKernelSupported(kernel)) {
+                    continue;
+                }
+
+                const auto blend_span = font::GetBlendSpanFunction(kernel);
+                const bool verified = VerifyBlendKernel(blend_span, dst, expected, coverage);
+
+                /* Time blending glyph-like coverage over the fatal background. */
+                for (size_t i = 0; i < BufferSize; ++i) {
+                    coverage[i] = (i * 37) & 0xFF;
+                }
+
+                font::BuildBlendTable(std::addressof(g_blend_table), 0xFFFF);
+                for (const size_t width : BlendSpanWidths) {
+                    const size_t num_spans = BlendPixelsPerRun / width;
+                    std::fill(dst, dst + BufferSize, 0x39C9);
+
+                    const auto start_tick = os::GetSystemTick();
+                    for (size_t i = 0; i < num_spans; ++i) {
+                        const size_t offset = (i * width) % (BufferSize - width);
+                        blend_span(dst + offset, coverage + offset, width, g_blend_table);
+                    }
+                    const s64 elapsed = std::max<s64>(GetElapsedNanoSeconds(start_tick), 1);
+
+                    printf("Blend (%-6s, %4zu px spans): %8.2f Mpixels/s, %s\n", font::GetBlendKernelName(kernel), width, num_spans * width * 1000.0 / elapsed, CheckResult(verified, "bit-exact", "MISMATCH"));
+                }
+            }
+        }
+
+        void BenchmarkBlendTable() {
+            constexpr size_t NumPixels = 0x10000;
+            constexpr size_t Iterations = 256;
+
+            /* Time building a context's table, which SetFontColor pays whenever the color actually changes. */
+            constexpr u16 Colors[] = { 0xFFFF, 0xF800 };
+            s64 build_elapsed = 0;
+            for (size_t i = 0; i < Iterations; ++i) {
+                const auto start_tick = os::GetSystemTick();
+                font::BuildBlendTable(std::addressof(g_blend_table), Colors[i % util::size(Colors)]);
+                build_elapsed += GetElapsedNanoSeconds(start_tick);
+            }
+            font::BuildBlendTable(std::addressof(g_blend_table), 0xFFFF);
+
+            /* Compare per-pixel arithmetic and table lookups over every background and a spread of alphas. */
+            u16 sink = 0;
+            s64 elapsed[2];
+            for (size_t method = 0; method < 2; ++method) {
+                const auto start_tick = os::GetSystemTick();
+                for (size_t n = 0; n < Iterations; ++n) {
+                    for (size_t i = 0; i < NumPixels; ++i) {
+                        const u8 alpha = (i * 37 + n) & 0xFF;
+                        sink ^= method == 0 ? font::BlendPixel(0xFFFF, static_cast<u16>(i), alpha) : font::BlendPixelWithTable(g_blend_table, static_cast<u16>(i), alpha);
+                    }
+                }
+                elapsed[method] = std::max<s64>(GetElapsedNanoSeconds(start_tick), 1);
+            }
+
+            /* Measure quality as the largest per-channel difference from the arithmetic. */
+            u32 num_mismatches = 0, max_error = 0;
+            for (u32 alpha = 0; alpha <= 0xFF; ++alpha) {
+                for (size_t i = 0; i < NumPixels; ++i) {
+                    const u16 expected = font::BlendPixel(0xFFFF, static_cast<u16>(i), alpha);
+                    const u16 actual   = font::BlendPixelWithTable(g_blend_table, static_cast<u16>(i), alpha);
+                    if (expected != actual) {
+                        ++num_mismatches;
+                        max_error = std::max<u32>(max_error, std::abs(static_cast<s32>(expected >> 11) - static_cast<s32>(actual >> 11)));
+                        max_error = std::max<u32>(max_error, std::abs(static_cast<s32>((expected >> 5) & 0x3F) - static_cast<s32>((actual >> 5) & 0x3F)));
+                        max_error = std::max<u32>(max_error, std::abs(static_cast<s32>(expected & 0x1F) - static_cast<s32>(actual & 0x1F)));
+                    }
+                }
+            }
+
+            const size_t num_blends = NumPixels * Iterations;
+            printf("Blend pixel: arithmetic %.2f Mpixels/s, table %.2f Mpixels/s (%.1fx), table build %.1f us, %u mismatches (max error %u)%s [%04x]\n",
+                   num_blends * 1000.0 / elapsed[0], num_blends * 1000.0 / elapsed[1], static_cast<double>(elapsed[0]) / elapsed[1],
+                   build_elapsed / 1000.0 / Iterations, num_mismatches, max_error, CheckResult(num_mismatches == 0, "", " (FAILED)"), sink);
+        }
+
+        u32 GetLinearPixelOffset(u32 x, u32 y) {
+            return y * TextFramebufferWidth + x;
+        }
+
+        /* Column-major, so that no row is contiguous and drawing takes the per-pixel path, as with the real swizzled framebuffer. */
+        u32 GetColumnPixelOffset(u32 x, u32 y) {
+            return x * TextFramebufferHeight + y;
+        }
+
+        /* Two text framebuffers, one drawn the reference way and one the way being measured. */
+        class TextFramebufferPair {
+            NON_COPYABLE(TextFramebufferPair);
+            NON_MOVEABLE(TextFramebufferPair);
+            public:
+                static constexpr size_t NumPixels = TextFramebufferWidth * TextFramebufferHeight;
+            private:
+                u16 *m_expected;
+                u16 *m_actual;
+            public:
+                TextFramebufferPair() : m_expected(static_cast<u16 *>(std::malloc(NumPixels * sizeof(u16)))), m_actual(static_cast<u16 *>(std::malloc(NumPixels * sizeof(u16)))) {
+                    AMS_ABORT_UNLESS(m_expected != nullptr && m_actual != nullptr);
+                }
+
+                ~TextFramebufferPair() {
+                    std::free(m_expected);
+                    std::free(m_actual);
+                }
+
+                u16 *GetExpected() const { return m_expected; }
+                u16 *GetActual() const { return m_actual; }
+
+                bool Matches() const { return std::memcmp(m_expected, m_actual, NumPixels * sizeof(u16)) == 0; }
+        };
+
+        template<typename F>
+        s64 RenderText(u16 *fb, u32 (*unswizzle_func)(u32, u32), float font_size, u16 background, size_t iterations, F draw) {
+            /* Draw in white over the background, timing only the drawing. */
+            font::ConfigureFontFramebuffer(fb, TextFramebufferWidth, TextFramebufferHeight, unswizzle_func);
+            font::SetFontColor(0xFFFF);
+            font::SetFontSize(font_size);
+
+            s64 elapsed = 0;
+            for (size_t i = 0; i < iterations; ++i) {
+                std::fill(fb, fb + TextFramebufferWidth * TextFramebufferHeight, background);
+
+                const auto start_tick = os::GetSystemTick();
+                draw();
+                elapsed += GetElapsedNanoSeconds(start_tick);
+            }
+
+            return std::max<s64>(elapsed, 1);
+        }
+
+        s64 RenderText(u16 *fb, float font_size, size_t iterations) {
+            /* The paragraph over black, leaving room above the first baseline. */
+            return RenderText(fb, GetLinearPixelOffset, font_size, 0x0000, iterations, [] {
+                font::SetPosition(TextMargin, TextMargin);
+                font::Print(SupportParagraph);
+            });
+        }
+
+        void CompareText(const u16 *expected, const u16 *actual, size_t *out_num_different, double *out_mean_error) {
+            /* Compare the green channel, which has the most precision, scaled to 8 bits. */
+            size_t num_different = 0;
+            u64 total_error = 0;
+            for (size_t i = 0; i < TextFramebufferWidth * TextFramebufferHeight; ++i) {
+                const s32 error = std::abs(static_cast<s32>((expected[i] >> 5) & 0x3F) - static_cast<s32>((actual[i] >> 5) & 0x3F)) * 255 / 0x3F;
+                num_different += error != 0;
+                total_error   += error;
+            }
+
+            *out_num_different = num_different;
+            *out_mean_error    = num_different != 0 ? static_cast<double>(total_error) / num_different : 0.0;
+        }
+
+        void BenchmarkSignedDistanceField() {
+            TextFramebufferPair fbs;
+            u16 *expected = fbs.GetExpected(), *actual = fbs.GetActual();
+
+            for (const float font_size : TextFontSizes) {
+                /* Render once in each mode first, so that fields and caches are warm. */
+                font::SetSignedDistanceFieldEnabled(false);
+                RenderText(expected, font_size, 1);
+                const s64 exact_elapsed = RenderText(expected, font_size, TextIterations);
+
+                font::SetSignedDistanceFieldEnabled(true);
+                RenderText(actual, font_size, 1);
+                const s64 sdf_elapsed = RenderText(actual, font_size, TextIterations);
+
+                size_t num_different;
+                double mean_error;
+                CompareText(expected, actual, std::addressof(num_different), std::addressof(mean_error));
+
+                printf("SDF text (size %2.0f): bitmap %8.1f us, sdf %8.1f us (%.2fx), %zu pixels differ (mean error %.1f/255)\n", font_size,
+                       exact_elapsed / 1000.0 / TextIterations, sdf_elapsed / 1000.0 / TextIterations, static_cast<double>(exact_elapsed) / sdf_elapsed,
+                       num_different, mean_error);
+            }
+
+            font::SignedDistanceFieldStatistics sdf_stats;
+            font::GetSignedDistanceFieldStatistics(std::addressof(sdf_stats));
+            printf("SDF store: %zu glyphs, %zu bytes for all sizes, %" PRIu64 " lookups overflowed the table\n", sdf_stats.num_glyphs, sdf_stats.memory_size, sdf_stats.num_overflowed);
+
+            font::SetSignedDistanceFieldEnabled(false);
+            font::SetFontSize(16.0f);
+        }
+
+        void BenchmarkTextLayout() {
+            constexpr size_t NumPixels = TextFramebufferPair::NumPixels;
+            constexpr size_t MaxRuns = sizeof(SupportParagraph);
+            TextFramebufferPair fbs;
+            u16 *expected = fbs.GetExpected(), *actual = fbs.GetActual();
+            font::GlyphRun *runs = static_cast<font::GlyphRun *>(std::malloc(MaxRuns * sizeof(font::GlyphRun)));
+            AMS_ABORT_UNLESS(runs != nullptr);
+            ON_SCOPE_EXIT { std::free(runs); };
+
+            for (const float font_size : { 16.0f, 14.0f }) {
+                RenderText(expected, font_size, 1);
+
+                /* Time the two stages separately: laying out the paragraph, then drawing the runs. */
+                size_t num_runs = 0;
+                const char *layout_end = nullptr;
+                const auto layout_start_tick = os::GetSystemTick();
+                for (size_t i = 0; i < TextIterations; ++i) {
+                    font::SetPosition(TextMargin, TextMargin);
+                    layout_end = font::LayoutString(runs, MaxRuns, std::addressof(num_runs), SupportParagraph);
+                }
+                const s64 layout_elapsed = std::max<s64>(GetElapsedNanoSeconds(layout_start_tick), 1);
+
+                /* The whole paragraph fits, and a layout cut short by max_runs says where it stopped. */
+                font::GlyphRun truncated_runs[8];
+                size_t num_truncated_runs;
+                const char *truncated_end = font::LayoutString(truncated_runs, util::size(truncated_runs), std::addressof(num_truncated_runs), SupportParagraph);
+                const bool complete = layout_end == SupportParagraph + std::strlen(SupportParagraph) && num_truncated_runs == util::size(truncated_runs) && SupportParagraph < truncated_end && truncated_end < layout_end;
+
+                const s64 raster_elapsed = RenderText(actual, GetLinearPixelOffset, font_size, 0x0000, TextIterations, [&] {
+                    font::DrawGlyphRuns(runs, num_runs);
+                });
+
+                printf("Text layout (size %2.0f): %zu runs, layout %6.1f us, raster %6.1f us, %s, %s\n", font_size, num_runs,
+                       layout_elapsed / 1000.0 / TextIterations, raster_elapsed / 1000.0 / TextIterations,
+                       CheckResult(fbs.Matches(), "matches Print", "DIFFERS FROM PRINT"), CheckResult(complete, "truncation reported", "TRUNCATION NOT REPORTED"));
+
+                /* Measuring must agree with where printing leaves the pen, without touching the framebuffer. */
+                std::memcpy(expected, actual, NumPixels * sizeof(u16));
+                font::StringMetrics metrics;
+                const auto measure_start_tick = os::GetSystemTick();
+                for (size_t i = 0; i < TextIterations; ++i) {
+                    font::MeasureString(std::addressof(metrics), SupportParagraph);
+                }
+                const s64 measure_elapsed = std::max<s64>(GetElapsedNanoSeconds(measure_start_tick), 1);
+                const bool untouched = fbs.Matches();
+
+                bool matches = true;
+                for (const char *line : { "Please press the POWER Button to restart the console normally, or a VOL button", SubpixelLine, "BT[31]: ", "X29:" }) {
+                    font::StringMetrics line_metrics;
+                    font::MeasureString(std::addressof(line_metrics), line);
+
+                    font::SetPosition(TextMargin, TextMargin);
+                    font::PrintLine(line);
+                    const u32 height = font::GetY() - TextMargin;
+                    font::SetPosition(TextMargin, TextMargin);
+                    font::Print(line);
+                    matches &= line_metrics.width == font::GetX() - TextMargin && line_metrics.height == height && line_metrics.num_lines == 1;
+                }
+
+                font::SetPosition(TextMargin, TextMargin);
+                font::PrintLine(SupportParagraph);
+                matches &= metrics.height == font::GetY() - TextMargin && metrics.num_lines == std::count(SupportParagraph, SupportParagraph + std::strlen(SupportParagraph), '\n') + 1;
+
+                printf("Text measure (size %2.0f): %ux%u px, %u lines, %6.1f us, %s, %s\n", font_size, metrics.width, metrics.height, metrics.num_lines,
+                       measure_elapsed / 1000.0 / TextIterations, CheckResult(matches, "matches Print", "DIFFERS FROM PRINT"), CheckResult(untouched, "no pixels touched", "PIXELS TOUCHED"));
+            }
+
+            font::SetFontSize(16.0f);
+        }
+
+        void BenchmarkClipping() {
+            constexpr s32 ClipX = 200, ClipY = 40;
+            constexpr u32 ClipWidth = 400, ClipHeight = 100;
+            TextFramebufferPair fbs;
+            u16 *expected = fbs.GetExpected(), *actual = fbs.GetActual();
+
+            for (const float font_size : { 16.0f, 24.0f }) {
+                const s64 unclipped_elapsed = RenderText(expected, font_size, TextIterations);
+
+                /* Clipped text must match unclipped text inside the rectangle, and leave everything else alone. */
+                const s64 clipped_elapsed = RenderText(actual, GetLinearPixelOffset, font_size, 0x0000, TextIterations, [] {
+                    font::PushClipRect(ClipX, ClipY, ClipWidth, ClipHeight);
+                    font::SetPosition(TextMargin, TextMargin);
+                    font::Print(SupportParagraph);
+                    font::PopClipRect();
+                });
+
+                bool matches = true;
+                for (u32 y = 0; y < TextFramebufferHeight; ++y) {
+                    for (u32 x = 0; x < TextFramebufferWidth; ++x) {
+                        const bool inside = ClipX <= static_cast<s32>(x) && x < ClipX + ClipWidth && ClipY <= static_cast<s32>(y) && y < ClipY + ClipHeight;
+                        matches &= actual[GetLinearPixelOffset(x, y)] == (inside ? expected[GetLinearPixelOffset(x, y)] : 0x0000);
+                    }
+                }
+
+                /* Text running off every edge of the surface must not write outside it. */
+                font::ConfigureFontFramebuffer(actual, TextFramebufferWidth, TextFramebufferHeight, GetLinearPixelOffset);
+                for (const auto &[x, y] : { std::pair<u32, u32>{ 0, 0 }, { TextFramebufferWidth - 100, TextMargin }, { TextMargin, TextFramebufferHeight - 4 }, { TextFramebufferWidth - 4, TextFramebufferHeight + 8 } }) {
+                    font::SetPosition(x, y);
+                    font::Print(SupportParagraph);
+                }
+
+                printf("Clipping (size %2.0f): unclipped %8.1f us, clipped to %ux%u %8.1f us (%.2fx), %s\n", font_size,
+                       unclipped_elapsed / 1000.0 / TextIterations, ClipWidth, ClipHeight, clipped_elapsed / 1000.0 / TextIterations,
+                       static_cast<double>(unclipped_elapsed) / clipped_elapsed, CheckResult(matches, "matches unclipped", "MISMATCH"));
+            }
+
+            font::SetFontSize(16.0f);
+        }
+
+        void BenchmarkSubpixelPositioning() {
+            TextFramebufferPair fbs;
+            u16 *fb = fbs.GetActual();
+
+            for (const float font_size : TextFontSizes) {
+                s64 elapsed[2];
+                u32 line_width[2];
+                u64 misses[2];
+                for (size_t i = 0; i < 2; ++i) {
+                    font::SetSubpixelPositioningEnabled(i != 0);
+
+                    /* Count the rasterizations the first pass needs, then time warm passes. */
+                    font::GlyphCacheStatistics before, after;
+                    font::GetGlyphCacheStatistics(std::addressof(before));
+                    RenderText(fb, font_size, 1);
+                    font::GetGlyphCacheStatistics(std::addressof(after));
+                    misses[i] = after.misses - before.misses;
+
+                    elapsed[i] = RenderText(fb, font_size, TextIterations);
+
+                    /* Truncating every advance makes lines come out short; measure the longest one. */
+                    font::SetPosition(0, TextMargin);
+                    font::Print(SubpixelLine);
+                    line_width[i] = font::GetX();
+                }
+
+                printf("Subpixel text (size %2.0f): whole pixels %8.1f us, 4 phases %8.1f us (%.2fx), %" PRIu64 "/%" PRIu64 " rasterizations, longest line %u/%u px\n", font_size,
+                       elapsed[0] / 1000.0 / TextIterations, elapsed[1] / 1000.0 / TextIterations, static_cast<double>(elapsed[0]) / elapsed[1],
+                       misses[0], misses[1], line_width[0], line_width[1]);
+            }
+
+            font::SetSubpixelPositioningEnabled(false);
+            font::SetFontSize(16.0f);
+        }
+
+        void BenchmarkFontFallback() {
+            TextFramebufferPair fbs;
+            u16 *fb = fbs.GetActual();
+
+            font::ConfigureFontFramebuffer(fb, TextFramebufferWidth, TextFramebufferHeight, GetLinearPixelOffset);
+            font::SetFontColor(0xFFFF);
+            font::SetFontSize(16.0f);
+
+            /* Codepoints are resolved on first draw; later draws shouldn't search any cmap. */
+            u64 cmap_searches[2];
+            s64 elapsed[2];
+            for (size_t i = 0; i < 2; ++i) {
+                font::FontFaceStatistics before, after;
+                font::GetFontFaceStatistics(std::addressof(before));
+
+                const size_t iterations = i == 0 ? 1 : TextIterations;
+                const auto start_tick = os::GetSystemTick();
+                for (size_t n = 0; n < iterations; ++n) {
+                    font::SetPosition(TextMargin, TextMargin);
+                    font::Print(FallbackLine);
+                }
+                elapsed[i] = std::max<s64>(GetElapsedNanoSeconds(start_tick), 1) / iterations;
+
+                font::GetFontFaceStatistics(std::addressof(after));
+                cmap_searches[i] = after.cmap_searches - before.cmap_searches;
+            }
+
+            font::FontFaceStatistics stats;
+            font::GetFontFaceStatistics(std::addressof(stats));
+            printf("Font fallback: %zu faces, first draw %8.1f us (%" PRIu64 " cmap searches), later draws %8.1f us (%" PRIu64 " cmap searches over %zu draws), %zu fallback/%zu missing codepoints in decoded pages\n",
+                   stats.num_faces, elapsed[0] / 1000.0, cmap_searches[0], elapsed[1] / 1000.0, cmap_searches[1], TextIterations, stats.num_fallback, stats.num_missing);
+        }
+
+        void BenchmarkGlyphLookup() {
+            /* Check every codepoint in the ranges against a direct cmap search, then time lookups both ways. */
+            size_t num_codepoints = 0, num_mismatches = 0;
+            s64 elapsed[2] = {};
+            u64 sink = 0;
+            for (size_t i = 0; i < 2; ++i) {
+                font::SetCodepointPageTableEnabled(i != 0);
+
+                const auto start_tick = os::GetSystemTick();
+                for (size_t n = 0; n < GlyphLookupIterations; ++n) {
+                    for (const auto &[first, last] : GlyphLookupRanges) {
+                        for (u32 codepoint = first; codepoint < last; ++codepoint) {
+                            size_t face_index;
+                            sink += font::GetGlyphIndex(codepoint, std::addressof(face_index)) + face_index;
+                        }
+                    }
+                }
+                elapsed[i] = std::max<s64>(GetElapsedNanoSeconds(start_tick), 1);
+            }
+
+            for (const auto &[first, last] : GlyphLookupRanges) {
+                for (u32 codepoint = first; codepoint < last; ++codepoint) {
+                    size_t expected_face, actual_face;
+                    font::SetCodepointPageTableEnabled(false);
+                    const u32 expected = font::GetGlyphIndex(codepoint, std::addressof(expected_face));
+                    font::SetCodepointPageTableEnabled(true);
+                    const u32 actual = font::GetGlyphIndex(codepoint, std::addressof(actual_face));
+
+                    num_mismatches += expected != actual || expected_face != actual_face;
+                    ++num_codepoints;
+                }
+            }
+
+            font::FontFaceStatistics stats;
+            font::GetFontFaceStatistics(std::addressof(stats));
+
+            const size_t num_lookups = num_codepoints * GlyphLookupIterations;
+            printf("Glyph lookup: cmap search %.1f ns, page table %.1f ns (%.1fx), %zu mismatches over %zu codepoints%s, %zu pages (%zu bytes) [%" PRIx64 "]\n",
+                   static_cast<double>(elapsed[0]) / num_lookups, static_cast<double>(elapsed[1]) / num_lookups, static_cast<double>(elapsed[0]) / elapsed[1],
+                   num_mismatches, num_codepoints, CheckResult(num_mismatches == 0, "", " (FAILED)"), stats.num_pages, stats.page_table_size, sink);
+        }
+
+        void BenchmarkFormat() {
+            TextFramebufferPair fbs;
+
+            /* The fatal screen's formatted lines, and then the corners of each conversion, through printf and through the typed formatter. */
+            const auto draw_printf = [] {
+                font::SetPosition(TextMargin, TextMargin);
+                font::PrintFormat("Error Code: 2%03d-%04d (0x%x)\n", 2, 2, 0x202);
+                font::PrintFormatLine("Program:  %016llX", 0xCCCCCCCCCCCCCCCCull);
+                font::PrintFormatLine("Firmware: %s (Atmosphere %u.%u.%u-%s)", "16.0.0", ATMOSPHERE_RELEASE_VERSION, ams::GetGitRevision());
+                for (int i = 0; i < 16; ++i) {
+                    font::PrintFormat("BT[%02d]: ", i);
+                    font::PrintFormat("%s:", "X29");
+                }
+                font::PrintFormatLine("%d %5d %d %05d %lld %llu", -7, -42, 0, -42, std::numeric_limits<s64>::min(), std::numeric_limits<u64>::max());
+                font::PrintFormatLine("%x %X %08x %c%c {} %%", 0xDEADBEEFu, 0xFEDCBA98u, 0xABCu, 'o', 'k');
+                font::PrintFormatLine("%x %llX %hhx %c|%-5s|%-3c|%-4c|", -255, -1ll, static_cast<s8>(-2), 0x41, "ab", 'z', 0x42);
+            };
+            const auto draw_format = [] {
+                font::SetPosition(TextMargin, TextMargin);
+                font::Format("Error Code: 2{:03}-{:04} (0x{:x})\n", 2, 2, 0x202);
+                font::FormatLine("Program:  {:016X}", 0xCCCCCCCCCCCCCCCCull);
+                font::FormatLine("Firmware: {} (Atmosphere {}.{}.{}-{})", "16.0.0", ATMOSPHERE_RELEASE_VERSION, ams::GetGitRevision());
+                for (int i = 0; i < 16; ++i) {
+                    font::Format("BT[{:02}]: ", i);
+                    font::Format("{}:", "X29");
+                }
+                font::FormatLine("{} {:5} {:d} {:05} {} {}", -7, -42, 0, -42, std::numeric_limits<s64>::min(), std::numeric_limits<u64>::max());
+                font::FormatLine("{:x} {:X} {:08x} {}{:c} {{}} %", 0xDEADBEEFu, 0xFEDCBA98u, 0xABCu, 'o', 'k');
+                font::FormatLine("{:x} {:X} {:x} {:c}|{:5s}|{:3}|{:4c}|", -255, -1ll, static_cast<s8>(-2), 0x41, "ab", 'z', 0x42);
+            };
+
+            const s64 elapsed[2] = {
+                RenderText(fbs.GetExpected(), GetLinearPixelOffset, 16.0f, 0x0000, TextIterations, draw_printf),
+                RenderText(fbs.GetActual(), GetLinearPixelOffset, 16.0f, 0x0000, TextIterations, draw_format),
+            };
+
+            printf("Formatted text (size 16): printf %6.1f us, typed %6.1f us (%.2fx), %s\n",
+                   elapsed[0] / 1000.0 / TextIterations, elapsed[1] / 1000.0 / TextIterations, static_cast<double>(elapsed[0]) / elapsed[1],
+                   CheckResult(fbs.Matches(), "matches printf", "DIFFERS FROM PRINTF"));
+        }
+
+        void BenchmarkRasterizer() {
+            constexpr size_t GlyphBufferSize = 64 * 64;
+            u8 *glyphs[2];
+            for (auto &glyph : glyphs) {
+                glyph = static_cast<u8 *>(std::calloc(RasterizerCodePointCount, GlyphBufferSize));
+                AMS_ABORT_UNLESS(glyph != nullptr);
+            }
+            ON_SCOPE_EXIT { std::free(glyphs[0]); std::free(glyphs[1]); };
+            TextFramebufferPair fbs;
+            u16 *expected = fbs.GetExpected(), *actual = fbs.GetActual();
+
+            for (const auto &[reference, candidate, checked] : RasterizerComparisons) {
+                for (const float font_size : { 14.0f, 16.0f, 20.0f, 24.0f }) {
+                    const font::RasterizerVersion versions[] = { reference, candidate };
+                    for (auto &glyph : glyphs) {
+                        std::memset(glyph, 0, RasterizerCodePointCount * GlyphBufferSize);
+                    }
+
+                    /* Rasterize printable ASCII and Latin-1 with each rasterizer, bypassing the caches. */
+                    s64 elapsed[2] = {};
+                    size_t num_pixels = 0;
+                    for (size_t v = 0; v < util::size(versions); ++v) {
+                        const auto start_tick = os::GetSystemTick();
+                        for (size_t iter = 0; iter < RasterizerIterations; ++iter) {
+                            num_pixels = 0;
+                            for (size_t i = 0; i < RasterizerCodePointCount; ++i) {
+                                s32 width, height;
+                                AMS_ABORT_UNLESS(font::RasterizeGlyphBitmap(glyphs[v] + i * GlyphBufferSize, GlyphBufferSize, std::addressof(width), std::addressof(height), GetRasterizerCodePoint(i), font_size, versions[v]));
+                                num_pixels += width * height;
+                            }
+                        }
+                        elapsed[v] = std::max<s64>(GetElapsedNanoSeconds(start_tick), 1);
+                    }
+
+                    /* Both rasterizers fill the same boxes, so compare them pixel for pixel. */
+                    size_t num_different = 0;
+                    u32 max_error = 0;
+                    for (size_t i = 0; i < RasterizerCodePointCount * GlyphBufferSize; ++i) {
+                        const u32 error = std::abs(static_cast<s32>(glyphs[0][i]) - static_cast<s32>(glyphs[1][i]));
+                        num_different += error != 0;
+                        max_error = std::max(max_error, error);
+                    }
+
+                    /* And then the paragraph, drawn through the caches with each. */
+                    font::SetRasterizerVersion(candidate);
+                    RenderText(actual, font_size, 1);
+                    font::SetRasterizerVersion(reference);
+                    RenderText(expected, font_size, 1);
+
+                    size_t num_text_different;
+                    double mean_error;
+                    CompareText(expected, actual, std::addressof(num_text_different), std::addressof(mean_error));
+
+                    const bool matches = !checked || (max_error <= RasterizerMaxGlyphError && num_text_different <= RasterizerMaxTextDifferent);
+                    printf("Rasterizer (%s vs %s, size %2.0f): %6.1f ns/px, %6.1f ns/px (%.2fx), %zu/%zu glyph pixels differ (max error %u/255), %zu text pixels differ (mean error %.1f/255)%s\n",
+                           GetRasterizerName(reference), GetRasterizerName(candidate), font_size, static_cast<double>(elapsed[0]) / (num_pixels * RasterizerIterations), static_cast<double>(elapsed[1]) / (num_pixels * RasterizerIterations),
+                           static_cast<double>(elapsed[0]) / elapsed[1], num_different, num_pixels, max_error, num_text_different, mean_error, CheckResult(matches, "", " (FAILED)"));
+                }
+            }
+
+            for (const s32 scale_64ths : CubicOutlineScales) {
+                const float scale = scale_64ths / 64.0f;
+                const s32 size = (CubicOutlineSize * scale_64ths + 63) / 64 + 1;
+                const s32 off_y = -size + 1;
+                AMS_ABORT_UNLESS(size * size <= static_cast<s32>(GlyphBufferSize));
+                std::memset(glyphs[0], 0, GlyphBufferSize);
+                std::memset(glyphs[1], 0, GlyphBufferSize);
+
+                /* stb_truetype's rasterizer is the shared version 2 one, and takes the outline as it comes. */
+                stbtt_vertex vertices[util::size(CubicOutline)];
+                std::memcpy(vertices, CubicOutline, sizeof(vertices));
+                stbtt__bitmap bitmap = { size, size, size, glyphs[0] };
+                stbtt_Rasterize(std::addressof(bitmap), 0.35f, vertices, util::size(vertices), scale, scale, 0.0f, 0.0f, 0, off_y, 1, nullptr);
+                AMS_ABORT_UNLESS(font::impl::RasterizeGlyphShapeFixedPoint(glyphs[1], size, size, size, vertices, util::size(vertices), static_cast<u64>(scale_64ths) << 26, 0, 0, off_y, nullptr));
+
+                size_t num_different = 0;
+                u32 max_error = 0;
+                for (s32 i = 0; i < size * size; ++i) {
+                    const u32 error = std::abs(static_cast<s32>(glyphs[0][i]) - static_cast<s32>(glyphs[1][i]));
+                    num_different += error != 0;
+                    max_error = std::max(max_error, error);
+                }
+
+                printf("Rasterizer (v2 vs fixed, cubic outline at %2d px): %zu/%d pixels differ (max error %u/255)%s\n",
+                       size, num_different, size * size, max_error, CheckResult(max_error <= RasterizerMaxGlyphError, "", " (FAILED)"));
+            }
+
+            font::SetRasterizerVersion(font::RasterizerVersion_2);
+            font::SetFontSize(16.0f);
+        }
+
+        void DrawContextLines(font::FontContext *ctx, const char *str, size_t num_lines) {
+            /* Print up to num_lines lines of str, returning once the string runs out. */
+            char line[0x100];
+            for (size_t i = 0; i < num_lines && *str != '\0'; ++i) {
+                const char *end = std::strchr(str, '\n');
+                const size_t len = std::min<size_t>(end != nullptr ? end - str : std::strlen(str), sizeof(line) - 1);
+                std::memcpy(line, str, len);
+                line[len] = '\0';
+
+                ctx->PrintLine(line);
+                str = end != nullptr ? end + 1 : str + len;
+            }
+        }
+
+        void BenchmarkCoverageRuns() {
+            TextFramebufferPair fbs;
+            u16 *expected = fbs.GetExpected(), *actual = fbs.GetActual();
+
+            const auto render = [](u16 *fb, u32 (*unswizzle_func)(u32, u32), float font_size, bool use_runs) -> s64 {
+                font::SetCoverageRunsEnabled(use_runs);
+                return RenderText(fb, unswizzle_func, font_size, 0x39C9, TextIterations, [] {
+                    font::SetPosition(TextMargin, TextMargin);
+                    font::Print(SupportParagraph);
+                    font::PrintMonospaceU64(0x0123456789ABCDEF);
+                });
+            };
+
+            /* Size 16 is drawn from the atlas, and size 20 from the glyph cache. */
+            for (const auto &[layout_name, unswizzle_func] : { std::pair<const char *, u32 (*)(u32, u32)>{ "linear", GetLinearPixelOffset }, { "swizzled", GetColumnPixelOffset } }) {
+                for (const float font_size : { 16.0f, 20.0f }) {
+                    render(expected, unswizzle_func, font_size, false);
+                    const s64 blend_elapsed = render(expected, unswizzle_func, font_size, false);
+                    render(actual, unswizzle_func, font_size, true);
+                    const s64 runs_elapsed  = render(actual, unswizzle_func, font_size, true);
+
+                    printf("Coverage runs (%-8s size %2.0f): disabled %8.1f us, enabled %8.1f us (%.2fx), %s\n", layout_name, font_size,
+                           blend_elapsed / 1000.0 / TextIterations, runs_elapsed / 1000.0 / TextIterations, static_cast<double>(blend_elapsed) / runs_elapsed,
+                           CheckResult(fbs.Matches(), "matches", "MISMATCH"));
+                }
+            }
+
+            font::GlyphAtlasStatistics atlas_stats;
+            font::GetGlyphAtlasStatistics(std::addressof(atlas_stats));
+            printf("Coverage runs: %zu bytes for the atlas's %zu glyphs, against %zu bytes of atlas\n", atlas_stats.coverage_runs_size, atlas_stats.num_glyphs, atlas_stats.memory_size);
+
+            font::SetCoverageRunsEnabled(true);
+            font::SetFontSize(16.0f);
+        }
+
+        void BenchmarkSpanRasterization() {
+            constexpr size_t Iterations = 10;
+            TextFramebufferPair fbs;
+            u16 *expected = fbs.GetExpected(), *actual = fbs.GetActual();
+
+            /* Nothing stays cached at these sizes, so every glyph is rasterized on every pass. */
+            const auto render = [](u16 *fb, u32 (*unswizzle_func)(u32, u32), float font_size, bool use_spans) -> s64 {
+                font::SetSpanRasterizationEnabled(use_spans);
+                return RenderText(fb, unswizzle_func, font_size, 0x39C9, Iterations, [font_size] {
+                    font::SetPosition(0, font_size);
+                    font::Print(SupportParagraph);
+                });
+            };
+
+            for (const auto &[layout_name, unswizzle_func] : { std::pair<const char *, u32 (*)(u32, u32)>{ "linear", GetLinearPixelOffset }, { "swizzled", GetColumnPixelOffset } }) {
+                for (const float font_size : { 32.0f, 48.0f }) {
+                    font::GlyphCacheStatistics before, after;
+                    font::GetGlyphCacheStatistics(std::addressof(before));
+                    const s64 bitmap_elapsed = render(expected, unswizzle_func, font_size, false);
+                    font::GetGlyphCacheStatistics(std::addressof(after));
+                    const s64 spans_elapsed  = render(actual, unswizzle_func, font_size, true);
+
+                    printf("Span rasterization (%-8s size %2.0f): bitmap %8.1f us, spans %8.1f us (%.2fx), %" PRIu64 " glyphs per pass, %s\n", layout_name, font_size,
+                           bitmap_elapsed / 1000.0 / Iterations, spans_elapsed / 1000.0 / Iterations, static_cast<double>(bitmap_elapsed) / spans_elapsed,
+                           (after.misses - before.misses) / Iterations, CheckResult(fbs.Matches(), "matches", "MISMATCH"));
+                }
+            }
+
+            font::SetSpanRasterizationEnabled(true);
+            font::SetFontSize(16.0f);
+        }
+
+        void BenchmarkFontContexts() {
+            constexpr size_t NumPixels = TextFramebufferPair::NumPixels;
+            constexpr size_t NumLines = 7;
+            TextFramebufferPair fb_pairs[2];
+            u16 *expected[2] = { fb_pairs[0].GetExpected(), fb_pairs[1].GetExpected() };
+            u16 *actual[2]   = { fb_pairs[0].GetActual(), fb_pairs[1].GetActual() };
+
+            /* Two contexts that disagree on everything they own, drawing to their own surfaces. */
+            for (auto &context : g_benchmark_contexts) {
+                util::ConstructAt(context);
+            }
+            ON_SCOPE_EXIT {
+                for (auto &context : g_benchmark_contexts) {
+                    util::DestroyAt(context);
+                }
+            };
+
+            font::FontContext *contexts[2] = { util::GetPointer(g_benchmark_contexts[0]), util::GetPointer(g_benchmark_contexts[1]) };
+            contexts[1]->SetFontSize(24.0f);
+            contexts[1]->SetFontColor(0x07E0);
+            contexts[1]->SetSubpixelPositioningEnabled(true);
+            contexts[1]->SetSignedDistanceFieldEnabled(true);
+
+            const auto render = [&](u16 * const *fbs, bool interleave) -> s64 {
+                s64 elapsed = 0;
+                for (size_t iter = 0; iter < TextIterations; ++iter) {
+                    for (size_t i = 0; i < 2; ++i) {
+                        std::fill(fbs[i], fbs[i] + NumPixels, 0x0000);
+                        contexts[i]->ConfigureFramebuffer(fbs[i], TextFramebufferWidth, TextFramebufferHeight, GetLinearPixelOffset);
+                        contexts[i]->SetPosition(TextMargin, TextMargin);
+                    }
+
+                    const auto start_tick = os::GetSystemTick();
+                    if (interleave) {
+                        /* Alternate lines between the contexts, so that each draws with the other's state in the shared caches. */
+                        const char *strs[2] = { SupportParagraph, SupportParagraph };
+                        for (size_t line = 0; line < NumLines; ++line) {
+                            for (size_t i = 0; i < 2; ++i) {
+                                DrawContextLines(contexts[i], strs[i], 1);
+                                const char *end = std::strchr(strs[i], '\n');
+                                strs[i] = end != nullptr ? end + 1 : strs[i] + std::strlen(strs[i]);
+                            }
+                        }
+                        contexts[0]->PrintMonospaceU64(0x0123456789ABCDEF);
+                        contexts[1]->PrintMonospaceU64(0x0123456789ABCDEF);
+                    } else {
+                        for (size_t i = 0; i < 2; ++i) {
+                            DrawContextLines(contexts[i], SupportParagraph, NumLines);
+                            contexts[i]->PrintMonospaceU64(0x0123456789ABCDEF);
+                        }
+                    }
+                    elapsed += GetElapsedNanoSeconds(start_tick);
+                }
+                return std::max<s64>(elapsed, 1);
+            };
+
+            /* The default context must be left exactly where it was. */
+            font::SetPosition(TextMargin, TextMargin);
+            const u32 default_x = font::GetX(), default_y = font::GetY();
+
+            const s64 sequential_elapsed  = render(expected, false);
+            const s64 interleaved_elapsed = render(actual, true);
+
+            const bool matches = fb_pairs[0].Matches() && fb_pairs[1].Matches();
+            const bool untouched = font::GetX() == default_x && font::GetY() == default_y;
+
+            printf("Font contexts (sizes 16, 24): sequential %8.1f us, interleaved %8.1f us (%.2fx), %s, %s\n",
+                   sequential_elapsed / 1000.0 / TextIterations, interleaved_elapsed / 1000.0 / TextIterations, static_cast<double>(sequential_elapsed) / interleaved_elapsed,
+                   CheckResult(matches, "matches sequential", "DIFFERS FROM SEQUENTIAL"), CheckResult(untouched, "default context untouched", "DEFAULT CONTEXT MOVED"));
+        }
+
+    }
+
+    size_t RunBenchmarks() {
+        g_num_failed_checks = 0;
+
+        BenchmarkKerning();
+        BenchmarkBlend();
+        BenchmarkBlendTable();
+        BenchmarkTextLayout();
+        BenchmarkClipping();
+        BenchmarkSignedDistanceField();
+        BenchmarkSubpixelPositioning();
+        BenchmarkFontFallback();
+        BenchmarkGlyphLookup();
+        BenchmarkFontContexts();
+        BenchmarkFormat();
+        BenchmarkRasterizer();
+        BenchmarkCoverageRuns();
+        BenchmarkSpanRasterization();
+
+        return g_num_failed_checks;
+    }
+
+}
@@ -15,273 +15,2208 @@
  */
 #include <stratosphere.hpp>
 #include "fatal_font.hpp"
+#include "fatal_font_cache_file.hpp"
+#include "fatal_font_rasterizer.hpp"
 
 namespace ams::fatal::srv::font {
 
-    //constinit lmem::HeapHandle g_font_heap_handle;
-    //
-    //void SetHeapMemory(void *memory, size_t memory_size) {
-    //    g_font_heap_handle = lmem::CreateExpHeap(memory, memory_size, lmem::CreateOption_None);
-    //}
+    constinit FontHeap g_font_heap;
+
+    void SetHeapMemory(void *memory, size_t memory_size) {
+        g_font_heap.Initialize(memory, memory_size);
+    }
+
+    void GetHeapStatistics(FontHeapStatistics *out) {
+        g_font_heap.GetStatistics(out);
+    }
 
     void *AllocateForFont(size_t size) {
-        return std::malloc(size);
-        //return lmem::AllocateFromExpHeap(g_font_heap_handle, size);
+        /* Until we're given heap memory, fall back to the system allocator. */
+        if (!g_font_heap.IsInitialized()) {
+            return std::malloc(size);
+        }
+
+        return g_font_heap.Allocate(size);
+    }
+
+    void DeallocateForFont(void *p) {
+        if (p != nullptr) {
+            if (g_font_heap.Contains(p)) {
+                return g_font_heap.Free(p);
+            } else {
+                return std::free(p);
+            }
+        }
+    }
+
+    /* Rasterizer temporaries come from a bump region that is reset for each glyph, falling back to the font heap if it runs out. */
+    struct RasterizerArena {
+        u8 *buffer;
+        size_t size;
+        size_t used;
+    };
+
+    void *AllocateForRasterizer(size_t size, void *user_data) {
+        if (auto *arena = static_cast<RasterizerArena *>(user_data); arena != nullptr && arena->buffer != nullptr) {
+            const size_t aligned_size = util::AlignUp(size, alignof(std::max_align_t));
+            if (aligned_size <= arena->size - arena->used) {
+                void *p = arena->buffer + arena->used;
+                arena->used += aligned_size;
+                return p;
+            }
+        }
+
+        return AllocateForFont(size);
+    }
+
+    void DeallocateForRasterizer(void *p, void *user_data) {
+        if (auto *arena = static_cast<RasterizerArena *>(user_data); arena != nullptr && arena->buffer <= p && p < arena->buffer + arena->size) {
+            return;
+        }
+
+        return DeallocateForFont(p);
+    }
+
+    namespace impl {
+
+        /* Coverage bitmap for a single glyph, and where to draw it relative to the pen. */
+        struct GlyphBitmap {
+            const u8 *data;
+            s32 width;
+            s32 height;
+            s32 stride;
+            s32 x_offset;
+            s32 y_offset;
+            /* Coverage as runs of transparent, opaque and partial pixels, row after row; nullptr if the glyph has none. */
+            const u8 *runs;
+        };
+
+        /* Pre-packed ASCII atlas, for the font sizes used by the fatal screen. */
+        constexpr float AtlasFontSizes[] = { 16.0f, 14.0f };
+        constexpr size_t AtlasFontSizeCount = util::size(AtlasFontSizes);
+        constexpr u32 AtlasFirstCodePoint = 0x20;
+        constexpr u32 AtlasCodePointCount = 0x7F - AtlasFirstCodePoint;
+
+        /* The atlas is packed by the shared copy of stb_truetype's rasterizer, as is the compiled atlas by the generator. */
+        constexpr RasterizerVersion AtlasRasterizerVersion = RasterizerVersion_2;
+        constexpr s32 AtlasWidth = 256;
+        constexpr s32 AtlasMaxHeight = 1024;
+
+        struct GlyphAtlas {
+            float scale;
+            GlyphBitmap glyphs[AtlasCodePointCount];
+        };
+
+        /* Glyph atlas and metrics baked at build time by tools/fatal_font_atlas_generator.cpp, if present. */
+        struct CompiledGlyph {
+            u16 x;
+            u16 y;
+            u8 width;
+            u8 height;
+            s8 x_offset;
+            s8 y_offset;
+            u16 advance_width;
+            s16 left_side_bearing;
+        };
+
+        struct CompiledFontSize {
+            float font_size;
+            float scale;
+            CompiledGlyph glyphs[AtlasCodePointCount];
+        };
+
+        struct CompiledKerningPair {
+            u16 pair;
+            s16 kern;
+        };
+
+        /* Flat per-size metrics for the most commonly drawn codepoints. */
+        constexpr u32 MetricsCodePointCount = 0x100;
+        constexpr size_t MetricsTableCount = 4;
+
+        struct GlyphMetrics {
+            u16 advance_width;
+            s16 left_side_bearing;
+            s16 x0;
+            s16 y0;
+            s16 x1;
+            s16 y1;
+        };
+
+        struct GlyphMetricsTable {
+            float scale;
+            u32 last_used;
+            bool valid;
+            u64 filled[MetricsCodePointCount / BITSIZEOF(u64)];
+            GlyphMetrics metrics[MetricsCodePointCount];
+
+            /* Monospace hex digit tiles, with centering folded into their offsets. */
+            u8 *hex_digit_pixels;
+            bool hex_digits_are_sdf;
+            RasterizerVersion hex_digits_rasterizer;
+            GlyphBitmap hex_digits[0x10];
+        };
+
+        /* Pen state carried between batches of glyph runs, and the extents of what has been laid out so far. */
+        struct TextLayoutState {
+            u32 x;
+            u32 y;
+            float x_fraction;
+            u32 line_x;
+            u32 prev_char;
+            bool first;
+            u32 num_newlines;
+            float max_width;
+        };
+
+        constexpr size_t GlyphRunBatchCount = 64;
+
+        /* Text drawn a codepoint at a time: runs are laid out into the batch, which is drawn whenever it fills. */
+        struct TextEmitter {
+            TextLayoutState state;
+            GlyphRun runs[GlyphRunBatchCount];
+            size_t num_runs;
+            bool mono;
+        };
+
+    }
+
+    namespace {
+
+        using namespace impl;
+
+        /* Font state shared by every context. Drawing holds the lock for the whole string, as a cached glyph is only valid until the caches below are next filled. */
+        /* Contexts keep their own state, but are serialized here rather than drawing concurrently. */
+        constinit os::SdkMutex g_font_mutex;
+        constinit util::TypedStorage<FontContext> g_default_context = {};
+
+        /* Subpixel pen tracking, with glyphs rasterized at a few quantized horizontal phases. */
+        constexpr u32 SubpixelPhaseCount = 4;
+
+        #if defined(ATMOSPHERE_BOARD_NINTENDO_NX)
+        PlFontData g_font;
+        #endif
+
+        /* The standard font, followed by the faces searched in order for codepoints it lacks. */
+        constexpr const char PrimaryFontFileName[] = "nintendo_udsg-r_std_003.ttf";
+        constexpr const char *FallbackFontFileNames[] = {
+            "nintendo_ext_003.ttf",
+            "nintendo_udsg-r_org_zh-cn_003.ttf",
+            "nintendo_udsg-r_ext_zh-cn_003.ttf",
+            "nintendo_udjxh-db_zh-tw_003.ttf",
+            "nintendo_udsg-r_ko_003.ttf",
+        };
+        constexpr size_t FontFaceCountMax = 1 + util::size(FallbackFontFileNames);
+
+        struct FontFace {
+            stbtt_fontinfo info;
+            const u8 *buffer;
+            size_t buffer_size;
+            float scale_ratio; /* Scale relative to the primary face, so that every face has the same pixel height. */
+        };
+
+        constinit FontFace g_font_faces[FontFaceCountMax] = {};
+        constinit size_t g_num_font_faces = 0;
+
+        struct FaceGlyph {
+            const FontFace *face;
+            int glyph_index;
+        };
+
+        /* Which face draws each codepoint, and with which glyph: a sparse page table decoded from the cmaps a page at a time, on first use. */
+        constexpr u32 CodepointPageShift = 8;
+        constexpr u32 CodepointPageSize = 1u << CodepointPageShift;
+        constexpr u32 CodepointMax = 0x10FFFF;
+        constexpr size_t CodepointPageCount = (CodepointMax + 1) >> CodepointPageShift;
+
+        struct CodepointPage {
+            u16 glyph_indices[CodepointPageSize];
+            u8 face_indices[CodepointPageSize];
+        };
+
+        constinit CodepointPage *g_codepoint_pages[CodepointPageCount] = {};
+        constinit bool g_codepoint_page_table_enabled = true;
+        constinit FontFaceStatistics g_font_face_statistics = {};
+
+        /* With a compiled atlas, the fatal screen is drawn without the font, so faces are only loaded once something else needs them. */
+        constinit bool g_font_faces_loaded = false;
+
+        ALWAYS_INLINE stbtt_fontinfo *GetPrimaryFont() {
+            return std::addressof(g_font_faces[0].info);
+        }
+
+        /* Persistent rasterization memory, so that drawing glyphs never touches the heap. */
+        constexpr size_t RasterizerArenaSize = 0x10000;
+
+        constinit RasterizerArena g_rasterizer_arena = {};
+        constinit u8 *g_raster_scratch = nullptr;
+        constinit size_t g_raster_scratch_size = 0;
+        constinit float g_raster_scratch_font_scale = 0.0f;
+
+        /* Whether glyphs too large for the cache are blended into the framebuffer as they are rasterized, rather than through the scratch buffer. */
+        constinit bool g_span_rasterization_enabled = true;
+
+        constinit const u8 *g_atlas_pixels = nullptr;
+        constinit u8 *g_atlas_coverage_runs = nullptr;
+        constinit GlyphAtlas g_atlases[AtlasFontSizeCount] = {};
+        constinit GlyphAtlasStatistics g_atlas_statistics = {};
+
+        #if __has_include("fatal_font_atlas.inc")
+        #define ATMOSPHERE_FATAL_FONT_HAS_COMPILED_ATLAS
+
+        #include "fatal_font_atlas.inc"
+        #endif
+
+        constinit GlyphMetricsTable g_metrics_tables[MetricsTableCount] = {};
+        constinit u32 g_metrics_tick = 0;
+
+        /* Printable ASCII kerning in font units, built on the first lookup rather than at startup, since drawing never kerns. */
+        constinit s16 (*g_kerning_matrix)[AtlasCodePointCount] = nullptr;
+        constinit bool g_kerning_matrix_built = false;
+
+        /* Glyph cache. Each entry owns a fixed-size slot of a pool allocated up front; larger glyphs are drawn from the scratch buffer uncached. */
+        constexpr size_t GlyphCacheWayCount = 4;
+        constexpr size_t GlyphCacheSetCount = 64;
+        constexpr size_t GlyphCacheSlotSize = 0x200;
+
+        /* Whether glyphs with coverage runs are drawn from them, rather than by blending every pixel. */
+        constinit bool g_coverage_runs_enabled = true;
+
+        struct GlyphCacheEntry {
+            GlyphBitmap glyph;
+            u32 codepoint;
+            float scale;
+            u32 last_used;
+            u8 phase;
+            bool is_sdf;
+            u8 rasterizer;
+            bool valid;
+        };
+
+        constinit GlyphCacheEntry g_glyph_cache[GlyphCacheSetCount][GlyphCacheWayCount] = {};
+        constinit u8 *g_glyph_cache_pixels = nullptr;
+        constinit u32 g_glyph_cache_tick = 0;
+        constinit GlyphCacheStatistics g_glyph_cache_statistics = {};
+
+        /* Signed distance fields, generated once per glyph at a reference size and resampled to whatever size is current. */
+        constexpr float SdfReferenceFontSize = 32.0f;
+        constexpr int SdfPadding = 4;
+        constexpr u8 SdfOnEdgeValue = 128;
+        constexpr float SdfPixelDistanceScale = static_cast<float>(SdfOnEdgeValue) / SdfPadding;
+        constexpr size_t SdfGlyphCount = 512;
+
+        struct SdfGlyph {
+            u8 *pixels;
+            s16 width;
+            s16 height;
+            s16 x_offset;
+            s16 y_offset;
+            u32 codepoint;
+            bool valid;
+        };
+
+        constinit SdfGlyph g_sdf_glyphs[SdfGlyphCount] = {};
+        constinit float g_sdf_scale = 0.0f;
+        constinit SignedDistanceFieldStatistics g_sdf_statistics = {};
+
+        /* Glyphs saved by a previous run, keyed by the font and the settings that affect rasterization. */
+        constinit GlyphCacheFile g_glyph_cache_file;
+        constinit char *g_glyph_cache_file_path = nullptr;
+        constinit u64 g_font_hash = 0;
+        constinit u64 g_rasterizer_settings_hash = 0;
+
+        /* Helpers. */
+        bool IsLinearFramebufferLayout(u32 (*unswizzle_func)(u32, u32)) {
+            /* Probe a block-linear GOB's worth of pixels, and a few points further out, for a row-major layout. */
+            const u32 base   = unswizzle_func(0, 0);
+            const u32 stride = unswizzle_func(0, 1) - base;
+            for (u32 y = 0; y < 8; ++y) {
+                for (u32 x = 0; x < 64; ++x) {
+                    if (unswizzle_func(x, y) != base + y * stride + x) {
+                        return false;
+                    }
+                }
+            }
+
+            constexpr std::pair<u32, u32> FarPoints[] = { { 255, 15 }, { 640, 360 }, { 1279, 719 } };
+            for (const auto &[x, y] : FarPoints) {
+                if (unswizzle_func(x, y) != base + y * stride + x) {
+                    return false;
+                }
+            }
+
+            return true;
+        }
+
+        float GetScaleForFontSize(float fsz) {
+            #if defined(ATMOSPHERE_FATAL_FONT_HAS_COMPILED_ATLAS)
+            return static_cast<float>(fsz * 1.375) / CompiledFontHeight;
+            #else
+            return stbtt_ScaleForPixelHeight(GetPrimaryFont(), fsz * 1.375);
+            #endif
+        }
+
+        s32 GetFontAscent() {
+            #if defined(ATMOSPHERE_FATAL_FONT_HAS_COMPILED_ATLAS)
+            return CompiledFontAscent;
+            #else
+            int ascent;
+            stbtt_GetFontVMetrics(GetPrimaryFont(), std::addressof(ascent), nullptr, nullptr);
+            return ascent;
+            #endif
+        }
+
+        FaceGlyph SearchFontFaces(u32 codepoint) {
+            for (size_t i = 0; i < g_num_font_faces; ++i) {
+                ++g_font_face_statistics.cmap_searches;
+                if (const int glyph_index = stbtt_FindGlyphIndex(std::addressof(g_font_faces[i].info), codepoint); glyph_index != 0) {
+                    return { g_font_faces + i, glyph_index };
+                }
+            }
+
+            /* No face has the codepoint, so the primary face's missing glyph is drawn. */
+            return { g_font_faces, 0 };
+        }
+
+        /* Font tables are big endian. */
+        constexpr u16 ReadFontU16(const u8 *p) {
+            return (static_cast<u16>(p[0]) << 8) | p[1];
+        }
+
+        constexpr s16 ReadFontS16(const u8 *p) {
+            return static_cast<s16>(ReadFontU16(p));
+        }
+
+        constexpr u32 ReadFontU32(const u8 *p) {
+            return (static_cast<u32>(ReadFontU16(p)) << 16) | ReadFontU16(p + 2);
+        }
+
+        void DecodeCmapPage(u16 *out_glyph_indices, const FontFace &face, u32 first_codepoint) {
+            /* Walk the cmap's ranges for the whole page at once, matching what stbtt_FindGlyphIndex would return for each codepoint. */
+            u8 *data = face.info.data;
+            const u32 index_map = face.info.index_map;
+            const u32 last_codepoint = first_codepoint + CodepointPageSize - 1;
+            std::memset(out_glyph_indices, 0, CodepointPageSize * sizeof(*out_glyph_indices));
+
+            switch (ReadFontU16(data + index_map)) {
+                case 4:
+                    {
+                        /* Each codepoint belongs to the first segment ending at or after it, if that segment starts at or before it. */
+                        const u32 seg_count   = ReadFontU16(data + index_map + 6) >> 1;
+                        const u32 end_codes   = index_map + 14;
+                        const u32 start_codes = end_codes + seg_count * 2 + 2;
+                        const u32 id_deltas   = end_codes + seg_count * 4 + 2;
+                        const u32 id_offsets  = end_codes + seg_count * 6 + 2;
+
+                        u32 codepoint = first_codepoint;
+                        for (u32 i = 0; i < seg_count && codepoint <= std::min<u32>(last_codepoint, 0xFFFF); ++i) {
+                            const u32 end = ReadFontU16(data + end_codes + 2 * i);
+                            if (end < codepoint) {
+                                continue;
+                            }
+
+                            const u32 start  = ReadFontU16(data + start_codes + 2 * i);
+                            const u32 offset = ReadFontU16(data + id_offsets + 2 * i);
+                            const s32 delta  = ReadFontS16(data + id_deltas + 2 * i);
+                            for (; codepoint <= std::min(end, last_codepoint); ++codepoint) {
+                                if (codepoint < start) {
+                                    continue;
+                                }
+
+                                out_glyph_indices[codepoint - first_codepoint] = offset == 0 ? static_cast<u16>(codepoint + delta) : ReadFontU16(data + id_offsets + 2 * i + offset + (codepoint - start) * 2);
+                            }
+                        }
+                    }
+                    break;
+                case 12:
+                case 13:
+                    {
+                        const bool is_many_to_one = ReadFontU16(data + index_map) == 13;
+                        const u32 num_groups = ReadFontU32(data + index_map + 12);
+                        for (u32 i = 0; i < num_groups; ++i) {
+                            const u32 group = index_map + 16 + i * 12;
+                            const u32 start = ReadFontU32(data + group), end = ReadFontU32(data + group + 4);
+                            if (end < first_codepoint) {
+                                continue;
+                            } else if (start > last_codepoint) {
+                                break;
+                            }
+
+                            const u32 start_glyph = ReadFontU32(data + group + 8);
+                            for (u32 codepoint = std::max(start, first_codepoint); codepoint <= std::min(end, last_codepoint); ++codepoint) {
+                                out_glyph_indices[codepoint - first_codepoint] = is_many_to_one ? start_glyph : start_glyph + (codepoint - start);
+                            }
+                        }
+                    }
+                    break;
+                default:
+                    /* Other formats are rare enough to just look up one codepoint at a time. */
+                    for (u32 i = 0; i < CodepointPageSize; ++i) {
+                        out_glyph_indices[i] = stbtt_FindGlyphIndex(std::addressof(face.info), first_codepoint + i);
+                    }
+                    break;
+            }
+        }
+
+        CodepointPage *BuildCodepointPage(u32 first_codepoint) {
+            auto *page = static_cast<CodepointPage *>(AllocateForFont(sizeof(CodepointPage)));
+            if (page == nullptr) {
+                return nullptr;
+            }
+            std::memset(page, 0, sizeof(*page));
+
+            /* Later faces only fill in what the faces before them lack. */
+            size_t num_missing = CodepointPageSize;
+            for (size_t i = 0; i < g_num_font_faces && num_missing != 0; ++i) {
+                u16 glyph_indices[CodepointPageSize];
+                DecodeCmapPage(glyph_indices, g_font_faces[i], first_codepoint);
+                ++g_font_face_statistics.cmap_searches;
+
+                for (u32 c = 0; c < CodepointPageSize; ++c) {
+                    if (page->glyph_indices[c] == 0 && glyph_indices[c] != 0) {
+                        page->glyph_indices[c] = glyph_indices[c];
+                        page->face_indices[c]  = i;
+                        --num_missing;
+
+                        if (i != 0) {
+                            ++g_font_face_statistics.num_fallback;
+                        }
+                    }
+                }
+            }
+
+            ++g_font_face_statistics.num_pages;
+            g_font_face_statistics.page_table_size += sizeof(CodepointPage);
+            g_font_face_statistics.num_missing     += num_missing;
+            return page;
+        }
+
+        FaceGlyph ResolveGlyph(u32 codepoint) {
+            if (AMS_LIKELY(g_codepoint_page_table_enabled && codepoint <= CodepointMax)) {
+                CodepointPage *&page = g_codepoint_pages[codepoint >> CodepointPageShift];
+                if (AMS_UNLIKELY(page == nullptr)) {
+                    page = BuildCodepointPage(codepoint & ~(CodepointPageSize - 1));
+                }
+
+                if (AMS_LIKELY(page != nullptr)) {
+                    const u32 index = codepoint % CodepointPageSize;
+                    return { g_font_faces + page->face_indices[index], page->glyph_indices[index] };
+                }
+            }
+
+            /* Without a page, every face's cmap is searched for the codepoint. */
+            return SearchFontFaces(codepoint);
+        }
+
+        void ReserveRasterScratch(float font_scale) {
+            /* Size the scratch buffer for the largest glyph any face can produce at this size; it only ever grows. */
+            g_raster_scratch_font_scale = std::max(g_raster_scratch_font_scale, font_scale);
+
+            size_t size = 0;
+            for (size_t i = 0; i < g_num_font_faces; ++i) {
+                const FontFace &face = g_font_faces[i];
+
+                int x0, y0, x1, y1;
+                stbtt_GetFontBoundingBox(std::addressof(face.info), std::addressof(x0), std::addressof(y0), std::addressof(x1), std::addressof(y1));
+
+                const size_t width  = static_cast<size_t>(std::ceil((x1 - x0) * font_scale * face.scale_ratio)) + 4;
+                const size_t height = static_cast<size_t>(std::ceil((y1 - y0) * font_scale * face.scale_ratio)) + 4;
+                size = std::max(size, width * height);
+            }
+
+            if (size > g_raster_scratch_size) {
+                DeallocateForFont(g_raster_scratch);
+                g_raster_scratch      = static_cast<u8 *>(AllocateForFont(size));
+                g_raster_scratch_size = size;
+                AMS_ABORT_UNLESS(g_raster_scratch != nullptr);
+            }
+        }
+
+        u64 ComputeFontHash() {
+            /* The table directory holds a checksum of every table, so it identifies each face without hashing all of it. */
+            u64 hash = HashGlyphCacheFileData(std::addressof(g_num_font_faces), sizeof(g_num_font_faces));
+            for (size_t i = 0; i < g_num_font_faces; ++i) {
+                const FontFace &face = g_font_faces[i];
+                const int offset = stbtt_GetFontOffsetForIndex(face.buffer, 0);
+                const size_t num_tables = (static_cast<size_t>(face.buffer[offset + 4]) << 8) | face.buffer[offset + 5];
+                const size_t directory_size = std::min<size_t>(12 + 16 * num_tables, face.buffer_size - offset);
+
+                hash = HashGlyphCacheFileData(std::addressof(face.buffer_size), sizeof(face.buffer_size), hash);
+                hash = HashGlyphCacheFileData(face.buffer + offset, directory_size, hash);
+            }
+            return hash;
+        }
+
+        u64 ComputeRasterizerSettingsHash() {
+            const u32 settings[] = { SubpixelPhaseCount, static_cast<u32>(SdfReferenceFontSize), SdfPadding, SdfOnEdgeValue, AtlasRasterizerVersion, impl::RasterizerAlgorithmRevision };
+            return HashGlyphCacheFileData(settings, sizeof(settings));
+        }
+
+        bool MapSharedFontFile(FontFace *face, const char *path) {
+            const u8 *data;
+            size_t size;
+            if (!MapReadOnlyFile(std::addressof(data), std::addressof(size), path)) {
+                return false;
+            }
+
+            face->buffer      = data;
+            face->buffer_size = size;
+            return true;
+        }
+
+        Result ReadSharedFontFile(FontFace *face, const char *path) {
+            /* Open shared font file. */
+            fs::FileHandle file;
+            R_TRY(fs::OpenFile(std::addressof(file), path, fs::OpenMode_Read));
+            ON_SCOPE_EXIT { fs::CloseFile(file); };
+
+            s64 size;
+            R_TRY(fs::GetFileSize(std::addressof(size), file));
+
+            /* Allocate font buffer. */
+            u8 *buffer = static_cast<u8 *>(std::malloc(size));
+            AMS_ABORT_UNLESS(buffer != nullptr);
+
+            /* Read the font buffer. */
+            if (const Result res = fs::ReadFile(file, 0, buffer, size); R_FAILED(res)) {
+                std::free(buffer);
+                R_RETURN(res);
+            }
+
+            face->buffer      = buffer;
+            face->buffer_size = size;
+            R_SUCCEED();
+        }
+
+        Result LoadFontFace(const char *file_name) {
+            const char *path = nullptr;
+            AMS_ABORT_UNLESS(CreateFilePath(std::addressof(path), file_name));
+            ON_SCOPE_EXIT { std::free(const_cast<char *>(path)); };
+
+            /* Map the font read-only and use it in place where we can, as NX does with shared memory. */
+            FontFace *face = g_font_faces + g_num_font_faces;
+            if (!MapSharedFontFile(face, path)) {
+                R_TRY(ReadSharedFontFile(face, path));
+            }
+
+            stbtt_InitFont(std::addressof(face->info), face->buffer, stbtt_GetFontOffsetForIndex(face->buffer, 0));
+            face->info.userdata = std::addressof(g_rasterizer_arena);
+            face->scale_ratio   = g_num_font_faces == 0 ? 1.0f : stbtt_ScaleForPixelHeight(std::addressof(face->info), 1.0f) / stbtt_ScaleForPixelHeight(GetPrimaryFont(), 1.0f);
+
+            ++g_num_font_faces;
+            R_SUCCEED();
+        }
+
+        Result LoadFontFaces() {
+            g_font_faces_loaded = true;
+
+            /* The standard font is required, but fallback faces are only used if present. */
+            R_TRY(LoadFontFace(PrimaryFontFileName));
+            for (const char *file_name : FallbackFontFileNames) {
+                static_cast<void>(LoadFontFace(file_name));
+            }
+            g_font_face_statistics.num_faces = g_num_font_faces;
+
+            /* Saved glyphs are only valid for the faces they were drawn from. */
+            g_font_hash = ComputeFontHash();
+            if (g_glyph_cache_file_path != nullptr) {
+                g_glyph_cache_file.Open(g_glyph_cache_file_path, g_font_hash, g_rasterizer_settings_hash);
+            }
+
+            /* Sizes set before the faces were loaded still need room to rasterize. */
+            if (g_raster_scratch_font_scale != 0.0f) {
+                ReserveRasterScratch(g_raster_scratch_font_scale);
+            }
+
+            R_SUCCEED();
+        }
+
+        bool EnsureFontFaces() {
+            if (AMS_UNLIKELY(!g_font_faces_loaded)) {
+                static_cast<void>(LoadFontFaces());
+            }
+
+            /* If the font can't be loaded, glyphs it would draw are left out. */
+            return g_num_font_faces != 0;
+        }
+
+        constexpr bool IsAtlasCodePoint(u32 codepoint) {
+            return AtlasFirstCodePoint <= codepoint && codepoint < AtlasFirstCodePoint + AtlasCodePointCount;
+        }
+
+        void ComputeGlyphMetrics(GlyphMetrics *out, u32 codepoint, float font_scale) {
+            if (!EnsureFontFaces()) {
+                *out = {};
+                return;
+            }
+
+            const auto [face, glyph_index] = ResolveGlyph(codepoint);
+
+            int adv_width, left_side_bearing;
+            stbtt_GetGlyphHMetrics(std::addressof(face->info), glyph_index, std::addressof(adv_width), std::addressof(left_side_bearing));
+
+            /* Advances are kept in the primary face's units, so that layout can scale every face the same way. */
+            if (face != g_font_faces) {
+                adv_width         = static_cast<int>(adv_width * face->scale_ratio + 0.5f);
+                left_side_bearing = static_cast<int>(std::floor(left_side_bearing * face->scale_ratio + 0.5f));
+            }
+
+            const float scale = font_scale * face->scale_ratio;
+            int x0, y0, x1, y1;
+            stbtt_GetGlyphBitmapBoxSubpixel(std::addressof(face->info), glyph_index, scale, scale, 0, 0, std::addressof(x0), std::addressof(y0), std::addressof(x1), std::addressof(y1));
+
+            *out = {
+                .advance_width     = static_cast<u16>(adv_width),
+                .left_side_bearing = static_cast<s16>(left_side_bearing),
+                .x0                = static_cast<s16>(x0),
+                .y0                = static_cast<s16>(y0),
+                .x1                = static_cast<s16>(x1),
+                .y1                = static_cast<s16>(y1),
+            };
+        }
+
+        constexpr size_t GetGlyphCacheSetIndex(u32 codepoint, float scale, u32 phase) {
+            const u32 scale_bits = std::bit_cast<u32>(scale);
+            return ((codepoint * 0x9E3779B1u) ^ (scale_bits >> 7) ^ scale_bits ^ (phase * 0x85EBCA6Bu)) % GlyphCacheSetCount;
+        }
+
+        const SdfGlyph *GetSdfGlyph(u32 codepoint) {
+            /* Look the glyph up in the open-addressed table, generating its field on first use. */
+            size_t index = (codepoint * 0x9E3779B1u) % SdfGlyphCount;
+            for (size_t i = 0; i < SdfGlyphCount; ++i, index = (index + 1) % SdfGlyphCount) {
+                SdfGlyph *sdf = g_sdf_glyphs + index;
+                if (sdf->valid) {
+                    if (sdf->codepoint == codepoint) {
+                        return sdf;
+                    }
+                    continue;
+                }
+
+                /* The field is allocated from the rasterizer arena, so copy it out to the font heap. */
+                const auto [face, glyph_index] = ResolveGlyph(codepoint);
+
+                g_rasterizer_arena.used = 0;
+                int width = 0, height = 0, x_offset = 0, y_offset = 0;
+                u8 *field = stbtt_GetGlyphSDF(std::addressof(face->info), g_sdf_scale * face->scale_ratio, glyph_index, SdfPadding, SdfOnEdgeValue, SdfPixelDistanceScale, std::addressof(width), std::addressof(height), std::addressof(x_offset), std::addressof(y_offset));
+                ON_SCOPE_EXIT { stbtt_FreeSDF(field, face->info.userdata); };
+
+                u8 *pixels = nullptr;
+                if (field != nullptr) {
+                    if (pixels = static_cast<u8 *>(AllocateForFont(width * height)); pixels == nullptr) {
+                        return nullptr;
+                    }
+                    std::memcpy(pixels, field, width * height);
+                } else {
+                    width = height = 0;
+                }
+
+                *sdf = {
+                    .pixels    = pixels,
+                    .width     = static_cast<s16>(width),
+                    .height    = static_cast<s16>(height),
+                    .x_offset  = static_cast<s16>(x_offset),
+                    .y_offset  = static_cast<s16>(y_offset),
+                    .codepoint = codepoint,
+                    .valid     = true,
+                };
+
+                ++g_sdf_statistics.num_glyphs;
+                g_sdf_statistics.memory_size += width * height;
+
+                return sdf;
+            }
+
+            /* The table is full, so the glyph is drawn without a field. */
+            ++g_sdf_statistics.num_overflowed;
+            return nullptr;
+        }
+
+        ALWAYS_INLINE float SampleSdf(const SdfGlyph *sdf, float x, float y) {
+            /* Bilinearly filter the field, treating everything outside it as far outside the glyph. */
+            const float fx = std::floor(x), fy = std::floor(y);
+            const s32 ix = static_cast<s32>(fx), iy = static_cast<s32>(fy);
+            const float tx = x - fx, ty = y - fy;
+
+            const auto texel = [sdf](s32 x, s32 y) -> float {
+                return (0 <= x && x < sdf->width && 0 <= y && y < sdf->height) ? sdf->pixels[y * sdf->width + x] : 0.0f;
+            };
+
+            const float top    = texel(ix, iy)     + (texel(ix + 1, iy)     - texel(ix, iy))     * tx;
+            const float bottom = texel(ix, iy + 1) + (texel(ix + 1, iy + 1) - texel(ix, iy + 1)) * tx;
+            return top + (bottom - top) * ty;
+        }
+
+        void ResampleSdfGlyph(u8 *dst, const SdfGlyph *sdf, float font_scale, float shift_x, s32 x0, s32 y0, s32 width, s32 height) {
+            /* One destination pixel spans ratio field pixels, so the edge ramp is that many distance steps wide. */
+            const float ratio    = g_sdf_scale / font_scale;
+            const float inv_ramp = 1.0f / (SdfPixelDistanceScale * ratio);
+            for (s32 y = 0; y < height; ++y) {
+                const float sy = (y0 + y + 0.5f) * ratio - sdf->y_offset - 0.5f;
+                for (s32 x = 0; x < width; ++x) {
+                    const float sx = (x0 + x + 0.5f - shift_x) * ratio - sdf->x_offset - 0.5f;
+                    const float t  = std::clamp((SampleSdf(sdf, sx, sy) - SdfOnEdgeValue) * inv_ramp + 0.5f, 0.0f, 1.0f);
+                    dst[y * width + x] = static_cast<u8>(t * t * (3.0f - 2.0f * t) * 255.0f + 0.5f);
+                }
+            }
+        }
+
+        /* Converts a non-negative float to fixed point from its bits, rounding to nearest, so that the fixed point rasterizer never touches floating point. */
+        constexpr u64 ConvertToFixedPoint(float value, s32 fraction_bits) {
+            const u32 bits = std::bit_cast<u32>(value);
+            const s32 exponent = static_cast<s32>((bits >> 23) & 0xFF);
+            AMS_ASSERT((bits >> 31) == 0 && exponent != 0xFF);
+
+            /* Denormals are far below any fixed point resolution used here. */
+            if (exponent == 0) {
+                return 0;
+            }
+
+            /* The value is the mantissa, with its implicit leading one, times two to the exponent less the bias and the mantissa's width. */
+            const u64 mantissa = (bits & 0x7FFFFF) | 0x800000;
+            const s32 shift = exponent - 150 + fraction_bits;
+            if (shift >= 0) {
+                return mantissa << shift;
+            } else if (shift > -static_cast<s32>(BITSIZEOF(u64))) {
+                return (mantissa + (static_cast<u64>(1) << (-shift - 1))) >> -shift;
+            } else {
+                return 0;
+            }
+        }
+
+        /* The fixed point rasterizer takes its scale as 32.32, and its shift as 16.16. */
+        constexpr u64 GetFixedPointScale(float scale) {
+            return ConvertToFixedPoint(scale, 32);
+        }
+
+        constexpr s32 GetFixedPointShift(float shift) {
+            return static_cast<s32>(ConvertToFixedPoint(shift, 16));
+        }
+
+        static_assert(GetFixedPointScale(1.0f) == static_cast<u64>(1) << 32);
+        static_assert(GetFixedPointScale(0.0125f) == 53687092);
+        static_assert(GetFixedPointShift(0.75f) == 0xC000);
+        static_assert(GetFixedPointShift(0.0f) == 0);
+
+        const u8 *RasterizeGlyph(u8 *dst, size_t dst_size, u32 codepoint, float font_scale, RasterizerVersion rasterizer, const SdfGlyph *sdf, float shift_x, s32 x0, s32 y0, s32 width, s32 height) {
+            if (width <= 0 || height <= 0) {
+                return dst;
+            }
+
+            AMS_ABORT_UNLESS(static_cast<size_t>(width * height) <= dst_size);
+
+            if (sdf != nullptr) {
+                ResampleSdfGlyph(dst, sdf, font_scale, shift_x, x0, y0, width, height);
+            } else {
+                const auto [face, glyph_index] = ResolveGlyph(codepoint);
+                const float scale = font_scale * face->scale_ratio;
+
+                g_rasterizer_arena.used = 0;
+                if (rasterizer == RasterizerVersion_1) {
+                    impl::MakeGlyphBitmapSubpixelV1(std::addressof(face->info), dst, width, height, width, scale, scale, shift_x, 0.0f, glyph_index);
+                } else if (rasterizer != RasterizerVersion_FixedPoint || !impl::MakeGlyphBitmapFixedPoint(std::addressof(face->info), dst, width, height, width, GetFixedPointScale(scale), GetFixedPointShift(shift_x), x0, y0, glyph_index)) {
+                    /* Glyphs too complex or too wide for the fixed point rasterizer's memory fall back to the float one. */
+                    stbtt_MakeGlyphBitmapSubpixel(std::addressof(face->info), dst, width, height, width, scale, scale, shift_x, 0.0f, glyph_index);
+                }
+            }
+
+            return dst;
+        }
+
+        /* A coverage run is one byte: its type in the top two bits, and its length less one below them. */
+        enum CoverageRunType : u8 {
+            CoverageRunType_Transparent = 0,
+            CoverageRunType_Opaque      = 1,
+            CoverageRunType_Partial     = 2,
+        };
+
+        constexpr s32 CoverageRunTypeShift = 6;
+        constexpr s32 CoverageRunLengthMax = 1 << CoverageRunTypeShift;
+
+        constexpr CoverageRunType GetCoverageRunType(u8 coverage) {
+            return coverage == 0x00 ? CoverageRunType_Transparent : (coverage == 0xFF ? CoverageRunType_Opaque : CoverageRunType_Partial);
+        }
+
+        /* Encodes a glyph's coverage runs into dst, returning their size, or zero if they don't fit. With no dst, just counts them. */
+        size_t EncodeCoverageRuns(u8 *dst, size_t dst_size, const GlyphBitmap &glyph) {
+            size_t size = 0;
+            for (s32 y = 0; y < glyph.height; ++y) {
+                const u8 *row = glyph.data + y * glyph.stride;
+                for (s32 x = 0; x < glyph.width; /* ... */) {
+                    const CoverageRunType type = GetCoverageRunType(row[x]);
+
+                    s32 length = 1;
+                    while (x + length < glyph.width && length < CoverageRunLengthMax && GetCoverageRunType(row[x + length]) == type) {
+                        ++length;
+                    }
+
+                    if (dst != nullptr) {
+                        if (size == dst_size) {
+                            return 0;
+                        }
+                        dst[size] = (type << CoverageRunTypeShift) | (length - 1);
+                    }
+
+                    ++size;
+                    x += length;
+                }
+            }
+            return size;
+        }
+
+        constexpr GlyphCacheFileKey MakeGlyphCacheFileKey(u32 codepoint, float scale, u32 phase, bool is_sdf, u8 rasterizer) {
+            return { .codepoint = codepoint, .scale_bits = std::bit_cast<u32>(scale), .phase = static_cast<u8>(phase), .is_sdf = is_sdf, .rasterizer = rasterizer, .reserved = {} };
+        }
+
+        bool LoadSavedGlyph(GlyphBitmap *out, u32 codepoint, float scale, u32 phase, bool is_sdf, u8 rasterizer) {
+            if (!g_glyph_cache_file.IsOpen()) {
+                return false;
+            }
+
+            const GlyphCacheFileRecord *record = g_glyph_cache_file.Find(MakeGlyphCacheFileKey(codepoint, scale, phase, is_sdf, rasterizer));
+            GlyphCacheFileGlyph saved;
+            if (record == nullptr || !g_glyph_cache_file.GetGlyph(std::addressof(saved), record)) {
+                return false;
+            }
+
+            *out = { saved.data, saved.width, saved.height, saved.stride, saved.x_offset, saved.y_offset, nullptr };
+            return true;
+        }
+
+        u8 *EvictGlyphCacheEntry(GlyphCacheEntry *entry) {
+            /* Evict the entry, if it holds a glyph, and hand back the slot it owns. */
+            if (entry->valid) {
+                ++g_glyph_cache_statistics.evictions;
+                --g_glyph_cache_statistics.num_entries;
+                g_glyph_cache_statistics.bitmap_size -= entry->glyph.width * entry->glyph.height;
+
+                entry->valid = false;
+            }
+
+            return g_glyph_cache_pixels + (entry - std::addressof(g_glyph_cache[0][0])) * GlyphCacheSlotSize;
+        }
+
+        const GlyphBitmap *FillGlyphCacheEntry(GlyphCacheEntry *entry, u8 *slot, const GlyphBitmap &glyph, u32 codepoint, float scale, u32 phase, bool is_sdf, u8 rasterizer, u32 tick) {
+            *entry = {
+                .glyph      = glyph,
+                .codepoint  = codepoint,
+                .scale      = scale,
+                .last_used  = tick,
+                .phase      = static_cast<u8>(phase),
+                .is_sdf     = is_sdf,
+                .rasterizer = rasterizer,
+                .valid      = true,
+            };
+
+            /* The runs go in whatever the bitmap leaves of the slot, when they fit. */
+            const size_t bitmap_size = glyph.width * glyph.height;
+            if (EncodeCoverageRuns(slot + bitmap_size, GlyphCacheSlotSize - bitmap_size, entry->glyph) != 0) {
+                entry->glyph.runs = slot + bitmap_size;
+            }
+
+            ++g_glyph_cache_statistics.num_entries;
+            g_glyph_cache_statistics.bitmap_size += bitmap_size;
+
+            return std::addressof(entry->glyph);
+        }
+
+        void BuildKerningMatrix() {
+            g_kerning_matrix_built = true;
+
+            /* Without the matrix, pairs are looked up in the font instead. */
+            auto *matrix = static_cast<s16 (*)[AtlasCodePointCount]>(AllocateForFont(sizeof(s16) * AtlasCodePointCount * AtlasCodePointCount));
+            if (matrix == nullptr) {
+                return;
+            }
+
+            #if defined(ATMOSPHERE_FATAL_FONT_HAS_COMPILED_ATLAS)
+            {
+                /* The compiled pairs are already in font units, so the matrix can be filled without touching the font. */
+                std::memset(matrix, 0, sizeof(s16) * AtlasCodePointCount * AtlasCodePointCount);
+                for (const auto &pair : CompiledFontKerningPairs) {
+                    if (pair.pair < AtlasCodePointCount * AtlasCodePointCount) {
+                        matrix[pair.pair / AtlasCodePointCount][pair.pair % AtlasCodePointCount] = pair.kern;
+                    }
+                }
+
+                g_kerning_matrix = matrix;
+                return;
+            }
+            #endif
+
+            for (u32 first = 0; first < AtlasCodePointCount; ++first) {
+                for (u32 second = 0; second < AtlasCodePointCount; ++second) {
+                    matrix[first][second] = stbtt_GetCodepointKernAdvance(GetPrimaryFont(), AtlasFirstCodePoint + first, AtlasFirstCodePoint + second);
+                }
+            }
+
+            g_kerning_matrix = matrix;
+        }
+
+        const s16 (*GetKerningMatrix())[AtlasCodePointCount] {
+            if (AMS_UNLIKELY(!g_kerning_matrix_built)) {
+                BuildKerningMatrix();
+            }
+
+            return g_kerning_matrix;
+        }
+
+        bool TryPackGlyphAtlas(u8 *pixels, s32 height) {
+            /* Pack all sizes in a single pass, so that they share the atlas. */
+            stbtt_packedchar packed_chars[AtlasFontSizeCount][AtlasCodePointCount];
+            stbtt_pack_range ranges[AtlasFontSizeCount];
+            for (size_t i = 0; i < AtlasFontSizeCount; ++i) {
+                ranges[i] = {
+                    .font_size                        = static_cast<float>(AtlasFontSizes[i] * 1.375),
+                    .first_unicode_codepoint_in_range = AtlasFirstCodePoint,
+                    .array_of_unicode_codepoints      = nullptr,
+                    .num_chars                        = AtlasCodePointCount,
+                    .chardata_for_range               = packed_chars[i],
+                    .h_oversample                     = 0,
+                    .v_oversample                     = 0,
+                };
+            }
+
+            stbtt_pack_context pack_context;
+            if (!stbtt_PackBegin(std::addressof(pack_context), pixels, AtlasWidth, height, 0, 1, nullptr)) {
+                return false;
+            }
+            ON_SCOPE_EXIT { stbtt_PackEnd(std::addressof(pack_context)); };
+
+            if (!stbtt_PackFontRanges(std::addressof(pack_context), GetPrimaryFont()->data, 0, ranges, AtlasFontSizeCount)) {
+                return false;
+            }
+
+            /* Convert the packed rects into glyph bitmaps. */
+            for (size_t i = 0; i < AtlasFontSizeCount; ++i) {
+                g_atlases[i].scale = GetScaleForFontSize(AtlasFontSizes[i]);
+
+                for (size_t c = 0; c < AtlasCodePointCount; ++c) {
+                    const auto &packed = packed_chars[i][c];
+                    g_atlases[i].glyphs[c] = {
+                        .data     = pixels + packed.y0 * AtlasWidth + packed.x0,
+                        .width    = packed.x1 - packed.x0,
+                        .height   = packed.y1 - packed.y0,
+                        .stride   = AtlasWidth,
+                        .x_offset = static_cast<s32>(packed.xoff),
+                        .y_offset = static_cast<s32>(packed.yoff),
+                    };
+                }
+            }
+
+            return true;
+        }
+
+        bool LoadSavedGlyphAtlas() {
+            size_t memory_size = 0;
+            for (size_t i = 0; i < AtlasFontSizeCount; ++i) {
+                g_atlases[i].scale = GetScaleForFontSize(AtlasFontSizes[i]);
+
+                for (size_t c = 0; c < AtlasCodePointCount; ++c) {
+                    GlyphBitmap *glyph = g_atlases[i].glyphs + c;
+                    if (!LoadSavedGlyph(glyph, AtlasFirstCodePoint + c, g_atlases[i].scale, 0, false, AtlasRasterizerVersion)) {
+                        return false;
+                    }
+
+                    memory_size += glyph->width * glyph->height;
+                }
+            }
+
+            g_atlas_statistics = {
+                .memory_size     = memory_size,
+                .num_glyphs      = AtlasFontSizeCount * AtlasCodePointCount,
+                .is_compiled     = false,
+                .is_cached       = true,
+            };
+            return true;
+        }
+
+        void BuildGlyphAtlas() {
+            const auto start_tick = os::GetSystemTick();
+
+            #if defined(ATMOSPHERE_FATAL_FONT_HAS_COMPILED_ATLAS)
+            {
+                /* The atlas was baked at build time, so just point at it. */
+                for (size_t i = 0; i < AtlasFontSizeCount; ++i) {
+                    const auto &compiled = CompiledFontSizes[i];
+                    g_atlases[i].scale = compiled.scale;
+
+                    for (size_t c = 0; c < AtlasCodePointCount; ++c) {
+                        const auto &glyph = compiled.glyphs[c];
+                        g_atlases[i].glyphs[c] = {
+                            .data     = CompiledFontAtlasData + glyph.y * CompiledFontAtlasWidth + glyph.x,
+                            .width    = glyph.width,
+                            .height   = glyph.height,
+                            .stride   = CompiledFontAtlasWidth,
+                            .x_offset = glyph.x_offset,
+                            .y_offset = glyph.y_offset,
+                        };
+                    }
+                }
+
+                g_atlas_pixels = CompiledFontAtlasData;
+                g_atlas_statistics = {
+                    .width           = static_cast<u32>(CompiledFontAtlasWidth),
+                    .height          = static_cast<u32>(CompiledFontAtlasHeight),
+                    .memory_size     = sizeof(CompiledFontAtlasData),
+                    .num_glyphs      = AtlasFontSizeCount * AtlasCodePointCount,
+                    .build_time_us   = (os::ConvertToTimeSpan(os::GetSystemTick() - start_tick)).GetMicroSeconds(),
+                    .is_compiled     = true,
+                    .is_cached       = false,
+                };
+                return;
+            }
+            #endif
+
+            /* Use the atlas saved by a previous run, if it has every glyph. */
+            if (LoadSavedGlyphAtlas()) {
+                g_atlas_statistics.build_time_us = (os::ConvertToTimeSpan(os::GetSystemTick() - start_tick)).GetMicroSeconds();
+                return;
+            }
+
+            /* Grow the atlas until every glyph fits. */
+            for (s32 height = AtlasWidth / 2; height <= AtlasMaxHeight; height *= 2) {
+                u8 *pixels = static_cast<u8 *>(AllocateForFont(AtlasWidth * height));
+                AMS_ABORT_UNLESS(pixels != nullptr);
+
+                if (TryPackGlyphAtlas(pixels, height)) {
+                    g_atlas_pixels = pixels;
+                    g_atlas_statistics = {
+                        .width           = static_cast<u32>(AtlasWidth),
+                        .height          = static_cast<u32>(height),
+                        .memory_size     = static_cast<size_t>(AtlasWidth * height),
+                        .num_glyphs      = AtlasFontSizeCount * AtlasCodePointCount,
+                        .build_time_us   = (os::ConvertToTimeSpan(os::GetSystemTick() - start_tick)).GetMicroSeconds(),
+                        .is_compiled     = false,
+                        .is_cached       = false,
+                    };
+                    return;
+                }
+
+                DeallocateForFont(pixels);
+            }
+
+            /* If the glyphs somehow don't fit, everything will go through the glyph cache instead. */
+            g_atlas_statistics = {};
+        }
+
+        void EncodeGlyphAtlasCoverageRuns() {
+            if (g_atlas_statistics.num_glyphs == 0) {
+                return;
+            }
+
+            /* Count the runs first, so that every glyph's runs share one allocation. */
+            size_t total_size = 0;
+            for (const auto &atlas : g_atlases) {
+                for (const auto &glyph : atlas.glyphs) {
+                    total_size += EncodeCoverageRuns(nullptr, 0, glyph);
+                }
+            }
+
+            /* The runs only speed drawing up, so the atlas works without them. */
+            g_atlas_coverage_runs = static_cast<u8 *>(AllocateForFont(std::max<size_t>(total_size, 1)));
+            if (g_atlas_coverage_runs == nullptr) {
+                return;
+            }
+
+            u8 *dst = g_atlas_coverage_runs;
+            for (auto &atlas : g_atlases) {
+                for (auto &glyph : atlas.glyphs) {
+                    const size_t size = EncodeCoverageRuns(dst, g_atlas_coverage_runs + total_size - dst, glyph);
+                    glyph.runs = size != 0 ? dst : nullptr;
+                    dst += size;
+                }
+            }
+
+            g_atlas_statistics.coverage_runs_size = total_size;
+        }
+
+        constexpr const char HexDigits[] = "0123456789ABCDEF";
+
+    }
+
+    GlyphMetrics FontContext::GetGlyphMetrics(u32 codepoint) {
+        /* Another context may have evicted our table since we last drew. */
+        if (m_metrics == nullptr || m_metrics->scale != m_font_size) {
+            SelectGlyphMetricsTable();
+        }
+
+        GlyphMetrics metrics;
+        if (codepoint < MetricsCodePointCount) {
+            /* Entries the table doesn't have yet are filled on first use. */
+            u64 &filled = m_metrics->filled[codepoint / BITSIZEOF(u64)];
+            const u64 mask = static_cast<u64>(1) << (codepoint % BITSIZEOF(u64));
+            if (!(filled & mask)) {
+                ComputeGlyphMetrics(m_metrics->metrics + codepoint, codepoint, m_font_size);
+                filled |= mask;
+            }
+
+            metrics = m_metrics->metrics[codepoint];
+        } else {
+            ComputeGlyphMetrics(std::addressof(metrics), codepoint, m_font_size);
+        }
+
+        return metrics;
+    }
+
+    void FontContext::SelectGlyphMetricsTable() {
+        const u32 tick = ++g_metrics_tick;
+
+        /* Reuse the table for this size, if we have one. */
+        GlyphMetricsTable *victim = g_metrics_tables;
+        for (auto &table : g_metrics_tables) {
+            if (table.valid && table.scale == m_font_size) {
+                table.last_used = tick;
+                m_metrics       = std::addressof(table);
+                return;
+            }
+
+            if (victim->valid && (!table.valid || table.last_used < victim->last_used)) {
+                victim = std::addressof(table);
+            }
+        }
+
+        if (victim->hex_digit_pixels != nullptr) {
+            DeallocateForFont(victim->hex_digit_pixels);
+            victim->hex_digit_pixels = nullptr;
+        }
+
+        victim->scale     = m_font_size;
+        victim->last_used = tick;
+        victim->valid     = true;
+        std::memset(victim->filled, 0, sizeof(victim->filled));
+        m_metrics         = victim;
+
+        #if defined(ATMOSPHERE_FATAL_FONT_HAS_COMPILED_ATLAS)
+        if (m_compiled_size != nullptr) {
+            /* Sizes baked at build time fill printable ASCII from the compiled tables, and leave everything else to be filled on use. */
+            for (u32 c = 0; c < AtlasCodePointCount; ++c) {
+                const auto &glyph = m_compiled_size->glyphs[c];
+                victim->metrics[AtlasFirstCodePoint + c] = {
+                    .advance_width     = glyph.advance_width,
+                    .left_side_bearing = glyph.left_side_bearing,
+                    .x0                = glyph.x_offset,
+                    .y0                = glyph.y_offset,
+                    .x1                = static_cast<s16>(glyph.x_offset + glyph.width),
+                    .y1                = static_cast<s16>(glyph.y_offset + glyph.height),
+                };
+                victim->filled[(AtlasFirstCodePoint + c) / BITSIZEOF(u64)] |= static_cast<u64>(1) << ((AtlasFirstCodePoint + c) % BITSIZEOF(u64));
+            }
+            return;
+        }
+        #endif
+
+        for (u32 c = 0; c < MetricsCodePointCount; ++c) {
+            ComputeGlyphMetrics(victim->metrics + c, c, m_font_size);
+        }
+        std::memset(victim->filled, 0xFF, sizeof(victim->filled));
+    }
+
+    const GlyphBitmap *FontContext::GetGlyph(u32 codepoint, u32 phase, bool rasterize_uncached) {
+        /* Printable ASCII at the fatal screen's sizes comes straight from the atlas. */
+        if (m_atlas != nullptr && !m_sdf_enabled && m_rasterizer_version == AtlasRasterizerVersion && phase == 0 && AtlasFirstCodePoint <= codepoint && codepoint < AtlasFirstCodePoint + AtlasCodePointCount) {
+            return m_atlas->glyphs + (codepoint - AtlasFirstCodePoint);
+        }
+
+        GlyphCacheEntry *set = g_glyph_cache[GetGlyphCacheSetIndex(codepoint, m_font_size, phase)];
+        const u32 tick = ++g_glyph_cache_tick;
+
+        /* Look for the glyph, tracking the least recently used way as we go. */
+        GlyphCacheEntry *victim = set;
+        for (size_t i = 0; i < GlyphCacheWayCount; ++i) {
+            GlyphCacheEntry *entry = set + i;
+            if (entry->valid && entry->codepoint == codepoint && entry->scale == m_font_size && entry->phase == phase && entry->is_sdf == m_sdf_enabled && entry->rasterizer == m_rasterizer_version) {
+                ++g_glyph_cache_statistics.hits;
+                entry->last_used = tick;
+                return std::addressof(entry->glyph);
+            }
+
+            if (victim->valid && (!entry->valid || entry->last_used < victim->last_used)) {
+                victim = entry;
+            }
+        }
+
+        ++g_glyph_cache_statistics.misses;
+
+        /* Glyphs saved by a previous run are copied into a slot, so that later lookups hit; any too large for one are drawn straight from the file. */
+        if (GlyphBitmap saved; LoadSavedGlyph(std::addressof(saved), codepoint, m_font_size, phase, m_sdf_enabled, m_rasterizer_version)) {
+            ++g_glyph_cache_statistics.file_hits;
+
+            if (static_cast<size_t>(saved.width * saved.height) > GlyphCacheSlotSize) {
+                static constinit GlyphBitmap s_saved_glyph = {};
+                s_saved_glyph = saved;
+                return std::addressof(s_saved_glyph);
+            }
+
+            u8 *slot = EvictGlyphCacheEntry(victim);
+            for (s32 y = 0; y < saved.height; ++y) {
+                std::memcpy(slot + y * saved.width, saved.data + y * saved.stride, saved.width);
+            }
+
+            return FillGlyphCacheEntry(victim, slot, { slot, saved.width, saved.height, saved.width, saved.x_offset, saved.y_offset, nullptr }, codepoint, m_font_size, phase, m_sdf_enabled, m_rasterizer_version, tick);
+        }
+
+        /* Without a face to draw from, the glyph is left out. */
+        if (AMS_UNLIKELY(!EnsureFontFaces())) {
+            static constinit u8 s_empty_pixel = 0;
+            static constinit GlyphBitmap s_empty_glyph = { std::addressof(s_empty_pixel), 0, 0, 0, 0, 0, nullptr };
+            return std::addressof(s_empty_glyph);
+        }
+
+        /* In distance field mode, every size is resampled from the same field, with an extra pixel around the box for the smoothed edge. */
+        auto metrics = GetGlyphMetrics(codepoint);
+        const float shift_x = static_cast<float>(phase) / SubpixelPhaseCount;
+        if (phase != 0) {
+            const auto [face, glyph_index] = ResolveGlyph(codepoint);
+            const float scale = m_font_size * face->scale_ratio;
+
+            int x0, y0, x1, y1;
+            stbtt_GetGlyphBitmapBoxSubpixel(std::addressof(face->info), glyph_index, scale, scale, shift_x, 0.0f, std::addressof(x0), std::addressof(y0), std::addressof(x1), std::addressof(y1));
+            metrics.x0 = x0;
+            metrics.y0 = y0;
+            metrics.x1 = x1;
+            metrics.y1 = y1;
+        }
+
+        const SdfGlyph *sdf = m_sdf_enabled ? GetSdfGlyph(codepoint) : nullptr;
+        const s32 border = (sdf != nullptr && sdf->pixels != nullptr && metrics.x0 < metrics.x1 && metrics.y0 < metrics.y1) ? 1 : 0;
+        const s32 x0 = metrics.x0 - border, y0 = metrics.y0 - border;
+        const s32 width = metrics.x1 - metrics.x0 + 2 * border, height = metrics.y1 - metrics.y0 + 2 * border;
+
+        /* Glyphs too large for a cache slot are rasterized into the scratch buffer, and only live until the next rasterization. */
+        if (static_cast<size_t>(width * height) > GlyphCacheSlotSize) {
+            static constinit GlyphBitmap s_uncached_glyph = {};
+
+            /* Exact coverage can go straight to the framebuffer instead, in which case the caller only needs the glyph's placement. */
+            const bool rasterize = rasterize_uncached || sdf != nullptr || m_rasterizer_version != RasterizerVersion_2 || !g_span_rasterization_enabled;
+            s_uncached_glyph = { rasterize ? RasterizeGlyph(g_raster_scratch, g_raster_scratch_size, codepoint, m_font_size, m_rasterizer_version, sdf, shift_x, x0, y0, width, height) : nullptr, width, height, width, x0, y0, nullptr };
+            return std::addressof(s_uncached_glyph);
+        }
+
+        /* Rasterize the glyph into the victim's slot. */
+        u8 *slot = EvictGlyphCacheEntry(victim);
+        return FillGlyphCacheEntry(victim, slot, { RasterizeGlyph(slot, GlyphCacheSlotSize, codepoint, m_font_size, m_rasterizer_version, sdf, shift_x, x0, y0, width, height), width, height, width, x0, y0, nullptr }, codepoint, m_font_size, phase, m_sdf_enabled, m_rasterizer_version, tick);
+    }
+
+    bool FontContext::IntersectsClip(s32 left, s32 top, s32 right, s32 bottom) const {
+        const ClipRect &clip = m_clip_stack[m_clip_depth];
+        return std::max(left, clip.left) < std::min(right, clip.right) && std::max(top, clip.top) < std::min(bottom, clip.bottom);
+    }
+
+    void FontContext::DrawGlyph(const GlyphBitmap *glyph, s32 glyph_x, s32 glyph_y) {
+        /* A linear framebuffer blends whole rows as spans, which short glyph rows don't gain from splitting; pixel at a time, runs skip most of the work. */
+        if (!m_frame_buffer_is_linear && glyph->runs != nullptr && g_coverage_runs_enabled) {
+            return DrawGlyphCoverageRuns(glyph, glyph_x, glyph_y);
+        }
+
+        /* Intersect the glyph with the clip once, so the loops below never need to check bounds. */
+        const ClipRect &clip = m_clip_stack[m_clip_depth];
+        const s32 left  = std::max(glyph_x, clip.left), right  = std::min(glyph_x + glyph->width, clip.right);
+        const s32 top   = std::max(glyph_y, clip.top),  bottom = std::min(glyph_y + glyph->height, clip.bottom);
+        if (left >= right || top >= bottom) {
+            return;
+        }
+
+        const u8 *imageptr = glyph->data + (top - glyph_y) * glyph->stride + (left - glyph_x);
+        const u32 x = left, y = top;
+        const s32 width = right - left, height = bottom - top, stride = glyph->stride;
+
+        if (m_frame_buffer_is_linear) {
+            /* Each row of the glyph is contiguous in the framebuffer, so blend it as a span. */
+            for (int tmpy = 0; tmpy < height; tmpy++) {
+                m_blend_span(m_frame_buffer + m_unswizzle_func(x, y + tmpy), imageptr + stride * tmpy, width, m_blend_table);
+            }
+            return;
+        }
+
+        for (int tmpy = 0; tmpy < height; tmpy++) {
+            for (int tmpx = 0; tmpx < width; tmpx++) {
+                /* Implement very simple blending, as the bitmap value is an alpha value. */
+                u16 *ptr = m_frame_buffer + m_unswizzle_func(x + tmpx, y + tmpy);
+                *ptr = BlendPixelWithTable(m_blend_table, *ptr, imageptr[stride * tmpy + tmpx]);
+            }
+        }
+    }
+
+    void FontContext::DrawGlyphCoverageRuns(const GlyphBitmap *glyph, s32 glyph_x, s32 glyph_y) {
+        /* Clip in glyph coordinates, as that is where the runs are. */
+        const ClipRect &clip = m_clip_stack[m_clip_depth];
+        const s32 left = std::max(clip.left - glyph_x, 0), right  = std::min(clip.right - glyph_x, glyph->width);
+        const s32 top  = std::max(clip.top - glyph_y, 0),  bottom = std::min(clip.bottom - glyph_y, glyph->height);
+        if (left >= right || top >= bottom) {
+            return;
+        }
+
+        /* Transparent runs are skipped and opaque runs filled, so only partial coverage is blended. */
+        const u8 *run = glyph->runs;
+        for (s32 y = 0; y < bottom; ++y) {
+            const u8 *coverage = glyph->data + y * glyph->stride;
+            for (s32 x = 0; x < glyph->width; /* ... */) {
+                const CoverageRunType type = static_cast<CoverageRunType>(*run >> CoverageRunTypeShift);
+                const s32 start = std::max(x, left);
+                x += (*(run++) & (CoverageRunLengthMax - 1)) + 1;
+
+                if (y < top || type == CoverageRunType_Transparent) {
+                    continue;
+                }
+
+                for (s32 i = start, end = std::min(x, right); i < end; ++i) {
+                    u16 *ptr = m_frame_buffer + m_unswizzle_func(glyph_x + i, glyph_y + y);
+                    *ptr = type == CoverageRunType_Opaque ? m_font_color : BlendPixelWithTable(m_blend_table, *ptr, coverage[i]);
+                }
+            }
+        }
+    }
+
+    void FontContext::DrawGlyphSpans(const GlyphBitmap *glyph, u32 codepoint, u32 phase, s32 glyph_x, s32 glyph_y) {
+        struct SpanTarget {
+            FontContext *context;
+            s32 x;
+            s32 y;
+        };
+
+        const auto [face, glyph_index] = ResolveGlyph(codepoint);
+        const float scale = m_font_size * face->scale_ratio;
+
+        SpanTarget target = { this, glyph_x, glyph_y };
+        g_rasterizer_arena.used = 0;
+        impl::MakeGlyphSpansSubpixel(std::addressof(face->info), glyph->width, glyph->height, scale, scale, static_cast<float>(phase) / SubpixelPhaseCount, 0.0f, glyph_index, [](void *arg, s32 x, s32 y, const u8 *coverage, s32 count) {
+            const auto *target = static_cast<const SpanTarget *>(arg);
+            target->context->BlendCoverageSpan(target->x + x, target->y + y, coverage, count);
+        }, std::addressof(target));
+    }
+
+    void FontContext::BlendCoverageSpan(s32 x, s32 y, const u8 *coverage, s32 count) {
+        const ClipRect &clip = m_clip_stack[m_clip_depth];
+        const s32 left = std::max(x, clip.left), right = std::min(x + count, clip.right);
+        if (y < clip.top || y >= clip.bottom || left >= right) {
+            return;
+        }
+
+        coverage += left - x;
+        if (m_frame_buffer_is_linear) {
+            return m_blend_span(m_frame_buffer + m_unswizzle_func(left, y), coverage, right - left, m_blend_table);
+        }
+
+        for (s32 i = 0; i < right - left; ++i) {
+            u16 *ptr = m_frame_buffer + m_unswizzle_func(left + i, y);
+            *ptr = BlendPixelWithTable(m_blend_table, *ptr, coverage[i]);
+        }
     }
 
-    void DeallocateForFont(void *p) {
-        if (p != nullptr) {
-            return std::free(p);
+    float FontContext::GetScaledKernAdvance(u32 prev_char, u32 cur_char) {
+        if (m_kerning_matrix_enabled && IsAtlasCodePoint(prev_char) && IsAtlasCodePoint(cur_char)) {
+            if (const auto *matrix = GetKerningMatrix(); matrix != nullptr) {
+                return m_font_size * matrix[prev_char - AtlasFirstCodePoint][cur_char - AtlasFirstCodePoint];
+            }
+        }
+
+        if (!EnsureFontFaces()) {
+            return 0.0f;
         }
-        //if (p != nullptr) {
-        //    return lmem::FreeToExpHeap(g_font_heap_handle, p);
-        //}
+
+        /* Only glyphs from the same face can kern against each other. */
+        const auto [prev_face, prev_glyph_index] = ResolveGlyph(prev_char);
+        const auto [cur_face, cur_glyph_index]   = ResolveGlyph(cur_char);
+        if (prev_face != cur_face) {
+            return 0.0f;
+        }
+
+        return m_font_size * cur_face->scale_ratio * stbtt_GetGlyphKernAdvance(std::addressof(cur_face->info), prev_glyph_index, cur_glyph_index);
     }
 
+    void FontContext::BuildHexDigitTiles(GlyphMetricsTable *table) {
+        /* Size the tiles from the bitmaps themselves, which may be larger than the metrics' boxes, so that one allocation holds all of them. */
+        size_t total_size = 0;
+        for (size_t i = 0; i < util::size(table->hex_digits); ++i) {
+            const GlyphBitmap *glyph = GetGlyph(HexDigits[i]);
+            total_size += glyph->width * glyph->height;
+        }
+
+        /* Coverage runs never outnumber pixels, so the tiles' runs follow them in an allocation of twice the size. */
+        DeallocateForFont(table->hex_digit_pixels);
+        table->hex_digit_pixels   = static_cast<u8 *>(AllocateForFont(std::max<size_t>(2 * total_size, 1)));
+        table->hex_digits_are_sdf    = m_sdf_enabled;
+        table->hex_digits_rasterizer = m_rasterizer_version;
+        AMS_ABORT_UNLESS(table->hex_digit_pixels != nullptr);
+
+        u8 *dst = table->hex_digit_pixels;
+        for (size_t i = 0; i < util::size(table->hex_digits); ++i) {
+            const u32 cur_width = static_cast<u32>(GetGlyphMetrics(HexDigits[i]).advance_width) * m_font_size;
+            const u32 centering = m_mono_adv > cur_width ? ((m_mono_adv - cur_width) / 2) : 0;
+
+            /* Copy the glyph out immediately, as a later lookup may evict it from the cache; it comes out the same size as when it was measured. */
+            const GlyphBitmap *glyph = GetGlyph(HexDigits[i]);
+            for (s32 y = 0; y < glyph->height; ++y) {
+                std::memcpy(dst + y * glyph->width, glyph->data + y * glyph->stride, glyph->width);
+            }
 
-}
+            table->hex_digits[i] = {
+                .data     = dst,
+                .width    = glyph->width,
+                .height   = glyph->height,
+                .stride   = glyph->width,
+                .x_offset = glyph->x_offset + static_cast<s32>(centering),
+                .y_offset = glyph->y_offset,
+            };
+
+            dst += glyph->width * glyph->height;
+            AMS_ABORT_UNLESS(dst <= table->hex_digit_pixels + total_size);
+        }
 
-#define STBTT_assert(x)    AMS_ASSERT(x)
-#define STBTT_malloc(x,u)  ((void)(u),ams::fatal::srv::font::AllocateForFont(x))
-#define STBTT_free(x,u)    ((void)(u),ams::fatal::srv::font::DeallocateForFont(x))
+        u8 *runs = table->hex_digit_pixels + total_size;
+        for (auto &tile : table->hex_digits) {
+            const size_t size = EncodeCoverageRuns(runs, table->hex_digit_pixels + 2 * total_size - runs, tile);
+            tile.runs = size != 0 ? runs : nullptr;
+            runs += size;
+        }
+    }
 
-#define STBTT_STATIC
-#define STB_TRUETYPE_IMPLEMENTATION
-#include "stb_truetype.h"
-#undef  STBTT_STATIC
-#undef  STB_TRUETYPE_IMPLEMENTATION
+    void FontContext::DrawHexDigits(u64 value, size_t num_digits) {
+        std::scoped_lock lk(g_font_mutex);
 
-#undef  STBTT_malloc
-#undef  STBTT_free
-#undef  STBTT_assert
+        /* Tiles are shared by every context at this size, and rebuilt whenever one draws them in the other mode. */
+        if (m_metrics == nullptr || m_metrics->scale != m_font_size) {
+            SelectGlyphMetricsTable();
+        }
+        if (m_metrics->hex_digit_pixels == nullptr || m_metrics->hex_digits_are_sdf != m_sdf_enabled || m_metrics->hex_digits_rasterizer != m_rasterizer_version) {
+            BuildHexDigitTiles(m_metrics);
+        }
 
-/* Define color conversion macros. */
-#define RGB888_TO_RGB565(r, g, b) ((((r >> 3) << 11) & 0xF800) | (((g >> 2) << 5) & 0x7E0) | ((b >> 3) & 0x1F))
-#define RGB565_GET_R8(c) ((((c >> 11) & 0x1F) << 3) | ((c >> 13) & 7))
-#define RGB565_GET_G8(c) ((((c >> 5) & 0x3F) << 2) | ((c >> 9) & 3))
-#define RGB565_GET_B8(c) ((((c >> 0) & 0x1F) << 3) | ((c >> 2) & 7))
+        u32 cur_x = m_cur_x;
+        for (size_t i = 0; i < num_digits; ++i) {
+            const GlyphBitmap *tile = m_metrics->hex_digits + ((value >> (4 * (num_digits - 1 - i))) & 0xF);
+            DrawGlyph(tile, static_cast<s32>(cur_x) + tile->x_offset, static_cast<s32>(m_cur_y) + tile->y_offset);
+            cur_x += m_mono_adv;
+        }
 
-namespace ams::fatal::srv::font {
+        /* Monospace digits land on whole pixels, like any other monospace text. */
+        m_cur_x = cur_x;
+        m_cur_x_fraction = 0.0f;
+    }
 
-    namespace {
+    void FontContext::LayoutCodepoint(GlyphRun *runs, size_t *num_runs, TextLayoutState *state, u32 cur_char, bool mono) {
+        u32 cur_x = state->x, cur_y = state->y;
 
-        /* Font state globals. */
-        u16 *g_frame_buffer = nullptr;
-        u32 (*g_unswizzle_func)(u32, u32) = nullptr;
-        u16 g_font_color = 0xFFFF; /* White. */
-        float g_font_line_pixels = 16.0f;
-        float g_font_size = 16.0f;
-        u32 g_line_x = 0, g_cur_x = 0, g_cur_y = 0;
+        /* With subpixel positioning, proportional text keeps the fractional part of the pen instead of truncating it. */
+        const bool subpixel = m_subpixel_enabled && !mono;
+        float cur_x_fraction = subpixel ? state->x_fraction : 0.0f;
 
-        u32 g_mono_adv = 0;
+        const auto advance_pen = [&](float advance) {
+            const float pen = cur_x_fraction + advance;
+            const float whole = std::floor(pen);
+            cur_x += static_cast<s32>(whole);
+            cur_x_fraction = pen - whole;
+        };
 
-        #if defined(ATMOSPHERE_BOARD_NINTENDO_NX)
-        PlFontData g_font;
-        #else
-        u8 *g_font_buffer = nullptr;
-        #endif
+        if (!m_mono_adv && !state->first) {
+            if (subpixel) {
+                advance_pen(GetScaledKernAdvance(state->prev_char, cur_char));
+            } else {
+                cur_x += GetScaledKernAdvance(state->prev_char, cur_char);
+            }
+        }
 
-        stbtt_fontinfo g_stb_font;
+        state->first = false;
 
-        /* Helpers. */
-        u16 Blend(u16 color, u16 bg, u8 alpha) {
-            const u32 c_r = RGB565_GET_R8(color);
-            const u32 c_g = RGB565_GET_G8(color);
-            const u32 c_b = RGB565_GET_B8(color);
-            const u32 b_r = RGB565_GET_R8(bg);
-            const u32 b_g = RGB565_GET_G8(bg);
-            const u32 b_b = RGB565_GET_B8(bg);
+        if (cur_char == '\n') {
+            state->x          = state->line_x;
+            state->y          = cur_y + m_font_line_pixels;
+            state->x_fraction = 0.0f;
+            ++state->num_newlines;
+            return;
+        }
 
-            const u32 r = ((alpha * c_r) + ((0xFF - alpha) * b_r)) / 0xFF;
-            const u32 g = ((alpha * c_g) + ((0xFF - alpha) * b_g)) / 0xFF;
-            const u32 b = ((alpha * c_b) + ((0xFF - alpha) * b_b)) / 0xFF;
+        if (subpixel) {
+            /* Round the fraction to the nearest phase, which may carry into the next whole pixel. */
+            const u32 phase   = static_cast<u32>(cur_x_fraction * SubpixelPhaseCount + 0.5f);
+            const float width = GetGlyphMetrics(cur_char).advance_width * m_font_size;
 
-            return RGB888_TO_RGB565(r, g, b);
+            runs[(*num_runs)++] = { cur_char, static_cast<s32>(cur_x + phase / SubpixelPhaseCount), static_cast<s32>(cur_y), width, static_cast<u8>(phase % SubpixelPhaseCount) };
+
+            advance_pen(width);
+        } else {
+            const u32 cur_width = static_cast<u32>(GetGlyphMetrics(cur_char).advance_width) * m_font_size;
+            const u32 advance   = mono ? m_mono_adv : cur_width;
+            const u32 centering = (mono && m_mono_adv > cur_width) ? ((m_mono_adv - cur_width) / 2) : 0;
+
+            runs[(*num_runs)++] = { cur_char, static_cast<s32>(cur_x + centering), static_cast<s32>(cur_y), static_cast<float>(advance), 0 };
+
+            cur_x += advance;
         }
 
-        void DrawCodePoint(u32 codepoint, u32 x, u32 y) {
-            int width = 0, height = 0;
-            u8* imageptr = stbtt_GetCodepointBitmap(std::addressof(g_stb_font), g_font_size, g_font_size, codepoint, std::addressof(width), std::addressof(height), 0, 0);
-            ON_SCOPE_EXIT { DeallocateForFont(imageptr); };
+        state->max_width  = std::max(state->max_width, static_cast<s32>(cur_x - state->line_x) + cur_x_fraction);
+        state->prev_char  = cur_char;
+        state->x          = cur_x;
+        state->x_fraction = cur_x_fraction;
+    }
+
+    const char *FontContext::LayoutGlyphRuns(GlyphRun *runs, size_t max_runs, size_t *out_num_runs, TextLayoutState *state, const char *str, const char *end, bool mono) {
+        size_t num_runs = 0;
+        while (str < end && num_runs < max_runs) {
+            char cur_char_data[4];
+            AMS_ABORT_UNLESS(util::PickOutCharacterFromUtf8String(cur_char_data, std::addressof(str)) == util::CharacterEncodingResult_Success);
 
-            for (int tmpy = 0; tmpy < height; tmpy++) {
-                for (int tmpx = 0; tmpx < width; tmpx++) {
-                    /* Implement very simple blending, as the bitmap value is an alpha value. */
-                    u16 *ptr = g_frame_buffer + g_unswizzle_func(x + tmpx, y + tmpy);
-                    *ptr = Blend(g_font_color, *ptr, imageptr[width * tmpy + tmpx]);
-                }
+            u32 cur_char;
+            AMS_ABORT_UNLESS(util::ConvertCharacterUtf8ToUtf32(std::addressof(cur_char), cur_char_data) == util::CharacterEncodingResult_Success);
+
+            LayoutCodepoint(runs, std::addressof(num_runs), state, cur_char, mono);
+        }
+
+        *out_num_runs = num_runs;
+        return str;
+    }
+
+    void FontContext::RasterizeGlyphRuns(const GlyphRun *runs, size_t num_runs) {
+        for (size_t i = 0; i < num_runs; ++i) {
+            /* Skip glyphs entirely outside the clip before rasterizing them, allowing a pixel for subpixel phases and distance field edges. */
+            const auto metrics = GetGlyphMetrics(runs[i].codepoint);
+            if (!IntersectsClip(runs[i].x + metrics.x0 - 1, runs[i].y + metrics.y0 - 1, runs[i].x + metrics.x1 + 1, runs[i].y + metrics.y1 + 1)) {
+                continue;
+            }
+
+            const GlyphBitmap *glyph = GetGlyph(runs[i].codepoint, runs[i].phase, false);
+            if (glyph->data != nullptr) {
+                DrawGlyph(glyph, runs[i].x + glyph->x_offset, runs[i].y + glyph->y_offset);
+            } else {
+                DrawGlyphSpans(glyph, runs[i].codepoint, runs[i].phase, runs[i].x + glyph->x_offset, runs[i].y + glyph->y_offset);
             }
         }
+    }
 
-        void DrawString(const char *str, bool add_line, bool mono = false) {
-            const size_t len = std::strlen(str);
-            const char * const end = str + len;
+    void FontContext::BeginText(TextEmitter *text, bool mono) {
+        text->state    = { .x = m_cur_x, .y = m_cur_y, .x_fraction = m_cur_x_fraction, .line_x = m_line_x, .first = true };
+        text->num_runs = 0;
+        text->mono     = mono;
+    }
 
-            u32 cur_x = g_cur_x, cur_y = g_cur_y;
+    void FontContext::EmitCodepoint(TextEmitter *text, u32 codepoint) {
+        LayoutCodepoint(text->runs, std::addressof(text->num_runs), std::addressof(text->state), codepoint, text->mono);
 
-            bool first = true;
+        /* Draw each batch before laying out the next. */
+        if (text->num_runs == util::size(text->runs)) {
+            RasterizeGlyphRuns(text->runs, text->num_runs);
+            text->num_runs = 0;
+        }
+    }
 
-            u32 prev_char = 0;
-            while (str < end) {
-                char cur_char_data[4];
-                AMS_ABORT_UNLESS(util::PickOutCharacterFromUtf8String(cur_char_data, std::addressof(str)) == util::CharacterEncodingResult_Success);
+    size_t FontContext::EmitString(TextEmitter *text, const char *str, const char *end) {
+        size_t num_codepoints = 0;
+        for (/* ... */; str < end; ++num_codepoints) {
+            char cur_char_data[4];
+            AMS_ABORT_UNLESS(util::PickOutCharacterFromUtf8String(cur_char_data, std::addressof(str)) == util::CharacterEncodingResult_Success);
 
-                u32 cur_char;
-                AMS_ABORT_UNLESS(util::ConvertCharacterUtf8ToUtf32(std::addressof(cur_char), cur_char_data) == util::CharacterEncodingResult_Success);
+            u32 cur_char;
+            AMS_ABORT_UNLESS(util::ConvertCharacterUtf8ToUtf32(std::addressof(cur_char), cur_char_data) == util::CharacterEncodingResult_Success);
 
-                if (!g_mono_adv && !first) {
-                    cur_x += g_font_size * stbtt_GetCodepointKernAdvance(std::addressof(g_stb_font), prev_char, cur_char);
-                }
+            EmitCodepoint(text, cur_char);
+        }
 
-                first = false;
+        return num_codepoints;
+    }
 
-                if (cur_char == '\n') {
-                    cur_x = g_line_x;
-                    cur_y += g_font_line_pixels;
-                    continue;
-                }
+    void FontContext::EmitInteger(TextEmitter *text, u64 magnitude, bool negative, const FormatSpec &spec) {
+        /* Digits come out least significant first. */
+        const u32 base = (spec.type == 'x' || spec.type == 'X') ? 16 : 10;
+        const char *digits = spec.type == 'x' ? "0123456789abcdef" : HexDigits;
+
+        char buf[BITSIZEOF(u64)];
+        size_t num_digits = 0;
+        do {
+            buf[num_digits++] = digits[magnitude % base];
+            magnitude /= base;
+        } while (magnitude != 0);
+
+        /* As with printf, zeros go between the sign and the digits, and spaces before the sign. */
+        const size_t length  = num_digits + (negative ? 1 : 0);
+        const size_t padding = spec.width > length ? spec.width - length : 0;
+        for (size_t i = 0; i < padding && !spec.zero_pad; ++i) {
+            EmitCodepoint(text, ' ');
+        }
+        if (negative) {
+            EmitCodepoint(text, '-');
+        }
+        for (size_t i = 0; i < padding && spec.zero_pad; ++i) {
+            EmitCodepoint(text, '0');
+        }
+        while (num_digits > 0) {
+            EmitCodepoint(text, buf[--num_digits]);
+        }
+    }
 
-                int adv_width, left_side_bearing;
-                stbtt_GetCodepointHMetrics(std::addressof(g_stb_font), cur_char, std::addressof(adv_width), std::addressof(left_side_bearing));
-                const u32 cur_width = static_cast<u32>(adv_width) * g_font_size;
+    void FontContext::EmitPadding(TextEmitter *text, size_t length, const FormatSpec &spec) {
+        for (size_t i = length; i < spec.width; ++i) {
+            EmitCodepoint(text, ' ');
+        }
+    }
 
-                int x0, y0, x1, y1;
-                stbtt_GetCodepointBitmapBoxSubpixel(std::addressof(g_stb_font), cur_char, g_font_size, g_font_size, 0, 0, std::addressof(x0), std::addressof(y0), std::addressof(x1), std::addressof(y1));
+    void FontContext::EndText(TextEmitter *text, bool add_line) {
+        RasterizeGlyphRuns(text->runs, text->num_runs);
+
+        if (add_line) {
+            /* Advance to next line. */
+            m_cur_x = m_line_x;
+            m_cur_x_fraction = 0.0f;
+            m_cur_y = text->state.y + m_font_line_pixels;
+        } else {
+            m_cur_x = text->state.x;
+            m_cur_x_fraction = text->state.x_fraction;
+            m_cur_y = text->state.y;
+        }
+    }
+
+    void FontContext::DrawString(const char *str, bool add_line, bool mono) {
+        std::scoped_lock lk(g_font_mutex);
+
+        TextEmitter text;
+        BeginText(std::addressof(text), mono);
+        EmitString(std::addressof(text), str, str + std::strlen(str));
+        EndText(std::addressof(text), add_line);
+    }
+
+    void FontContext::DrawFormat(const char *format, const FormatArg *args, bool add_line) {
+        std::scoped_lock lk(g_font_mutex);
 
-                DrawCodePoint(cur_char, cur_x + x0 + ((mono && g_mono_adv > cur_width) ? ((g_mono_adv - cur_width) / 2) : 0), cur_y + y0);
+        TextEmitter text;
+        BeginText(std::addressof(text), false);
 
-                cur_x += (mono ? g_mono_adv : cur_width);
+        /* The format string was checked against the arguments when it was compiled. */
+        const char *literal = format;
+        while (*format != '\0') {
+            if (format[0] != '{' && format[0] != '}') {
+                ++format;
+                continue;
+            }
 
-                prev_char = cur_char;
+            /* Draw the literal text up to here, and then the escaped brace or the argument. */
+            EmitString(std::addressof(text), literal, format);
+            if (format[0] == format[1]) {
+                EmitCodepoint(std::addressof(text), static_cast<u8>(format[0]));
+                literal = format += 2;
+                continue;
             }
 
-            if (add_line) {
-                /* Advance to next line. */
-                g_cur_x = g_line_x;
-                g_cur_y = cur_y + g_font_line_pixels;
+            FormatSpec spec;
+            literal = format = ParseFormatSpec(std::addressof(spec), format + 1);
+
+            const FormatArg &arg = *(args++);
+            if (arg.type == FormatArgType_String) {
+                EmitPadding(std::addressof(text), EmitString(std::addressof(text), arg.str, arg.str + std::strlen(arg.str)), spec);
+            } else if (arg.type == FormatArgType_Char || spec.type == 'c') {
+                EmitCodepoint(std::addressof(text), arg.type == FormatArgType_Char ? arg.c : static_cast<u32>(arg.u));
+                EmitPadding(std::addressof(text), 1, spec);
+            } else if (arg.type == FormatArgType_Unsigned) {
+                EmitInteger(std::addressof(text), arg.u, false, spec);
+            } else if (spec.type == 'x' || spec.type == 'X') {
+                /* Hex is two's complement of the argument's own width, so the bits above it must go. */
+                EmitInteger(std::addressof(text), arg.u & (std::numeric_limits<u64>::max() >> (BITSIZEOF(u64) - arg.size * BITSIZEOF(u8))), false, spec);
             } else {
-                g_cur_x = cur_x;
-                g_cur_y = cur_y;
+                EmitInteger(std::addressof(text), arg.s < 0 ? -static_cast<u64>(arg.s) : static_cast<u64>(arg.s), arg.s < 0, spec);
             }
         }
+        EmitString(std::addressof(text), literal, format);
 
+        EndText(std::addressof(text), add_line);
     }
 
-    void PrintLine(const char *str) {
-        return DrawString(str, true);
+    FontContext::FontContext()
+        : m_frame_buffer(nullptr), m_unswizzle_func(nullptr), m_frame_buffer_is_linear(false), m_clip_stack(), m_clip_depth(0),
+          m_blend_kernel(BlendKernel_Scalar), m_blend_span(GetBlendSpanFunction(BlendKernel_Scalar)), m_font_color(0xFFFF), m_blend_table(), m_font_line_pixels(0.0f), m_font_size(0.0f),
+          m_line_x(0), m_cur_x(0), m_cur_y(0), m_cur_x_fraction(0.0f), m_mono_adv(0), m_atlas(nullptr), m_compiled_size(nullptr), m_metrics(nullptr),
+          m_subpixel_enabled(false), m_sdf_enabled(false), m_kerning_matrix_enabled(true), m_rasterizer_version(AtlasRasterizerVersion)
+    {
+        BuildBlendTable(std::addressof(m_blend_table), m_font_color);
+        this->SetBlendKernel(SelectBlendKernel());
+        this->SetFontSize(16.0f);
     }
 
-    void PrintFormatLine(const char *format, ...) {
-        char char_buf[0x400];
+    void FontContext::ConfigureFramebuffer(u16 *fb, u32 width, u32 height, u32 (*unswizzle_func)(u32, u32)) {
+        m_frame_buffer = fb;
+        m_unswizzle_func = unswizzle_func;
+        m_frame_buffer_is_linear = IsLinearFramebufferLayout(unswizzle_func);
+
+        /* Nothing may be drawn outside the framebuffer. */
+        m_clip_stack[0] = { 0, 0, static_cast<s32>(width), static_cast<s32>(height) };
+        m_clip_depth    = 0;
+    }
+
+    void FontContext::PushClipRect(s32 x, s32 y, u32 width, u32 height) {
+        AMS_ABORT_UNLESS(m_clip_depth + 1 < ClipStackDepth);
+
+        /* The new clip is always within the current one. */
+        const ClipRect &cur = m_clip_stack[m_clip_depth];
+        const s32 right = std::min(x + static_cast<s32>(width), cur.right), bottom = std::min(y + static_cast<s32>(height), cur.bottom);
+        const s32 left  = std::min(std::max(x, cur.left), right), top = std::min(std::max(y, cur.top), bottom);
+
+        m_clip_stack[++m_clip_depth] = { left, top, right, bottom };
+    }
+
+    void FontContext::PopClipRect() {
+        AMS_ABORT_UNLESS(m_clip_depth > 0);
+        --m_clip_depth;
+    }
+
+    void FontContext::SetBlendKernel(BlendKernel kernel) {
+        AMS_ABORT_UNLESS(IsBlendKernelSupported(kernel));
+
+        m_blend_kernel = kernel;
+        m_blend_span   = GetBlendSpanFunction(kernel);
+    }
+
+    void FontContext::SetFontColor(u16 color) {
+        /* Rebuild the blend table here, so that drawing never has to check it. */
+        if (m_font_color != color) {
+            m_font_color = color;
+            BuildBlendTable(std::addressof(m_blend_table), color);
+        }
+    }
+
+    void FontContext::SetPosition(u32 x, u32 y) {
+        m_line_x = x;
+        m_cur_x = x;
+        m_cur_x_fraction = 0.0f;
+        m_cur_y = y;
+    }
+
+    void FontContext::SetFontSize(float fsz) {
+        std::scoped_lock lk(g_font_mutex);
+
+        #if defined(ATMOSPHERE_FATAL_FONT_HAS_COMPILED_ATLAS)
+        {
+            /* Sizes baked at build time don't need to touch the font at all. */
+            m_compiled_size = nullptr;
+            for (size_t i = 0; i < AtlasFontSizeCount; ++i) {
+                if (CompiledFontSizes[i].font_size == fsz) {
+                    m_compiled_size = CompiledFontSizes + i;
+                    m_atlas         = g_atlases + i;
+                    break;
+                }
+            }
+
+            if (m_compiled_size != nullptr) {
+                m_font_size        = m_compiled_size->scale;
+                m_font_line_pixels = CompiledFontAscent * m_font_size * 1.125;
+
+                SelectGlyphMetricsTable();
+                ReserveRasterScratch(m_font_size);
+                m_mono_adv = GetGlyphMetrics('A').advance_width * m_font_size;
+                return;
+            }
+        }
+        #endif
+
+        m_font_size = GetScaleForFontSize(fsz);
+
+        m_atlas = nullptr;
+        if (g_atlas_statistics.num_glyphs != 0) {
+            for (const auto &atlas : g_atlases) {
+                if (atlas.scale == m_font_size) {
+                    m_atlas = std::addressof(atlas);
+                    break;
+                }
+            }
+        }
+
+        m_font_line_pixels = GetFontAscent() * m_font_size * 1.125;
+
+        SelectGlyphMetricsTable();
+        ReserveRasterScratch(m_font_size);
+        m_mono_adv = GetGlyphMetrics('A').advance_width * m_font_size;
+    }
+
+    void FontContext::AddSpacingLines(float num_lines) {
+        m_cur_x = m_line_x;
+        m_cur_x_fraction = 0.0f;
+        m_cur_y += static_cast<u32>(m_font_line_pixels * num_lines);
+    }
+
+    void FontContext::PrintLine(const char *str) {
+        return DrawString(str, true);
+    }
 
+    void FontContext::PrintFormatLine(const char *format, ...) {
         std::va_list va_arg;
         va_start(va_arg, format);
-        util::VSNPrintf(char_buf, sizeof(char_buf), format, va_arg);
+        VPrintFormatLine(format, va_arg);
         va_end(va_arg);
+    }
+
+    void FontContext::VPrintFormatLine(const char *format, std::va_list va_arg) {
+        char char_buf[0x400];
+        util::VSNPrintf(char_buf, sizeof(char_buf), format, va_arg);
 
         PrintLine(char_buf);
     }
 
-    void Print(const char *str) {
+    void FontContext::Print(const char *str) {
         return DrawString(str, false);
     }
 
-    void PrintFormat(const char *format, ...) {
+    void FontContext::PrintFormat(const char *format, ...) {
+        std::va_list va_arg;
+        va_start(va_arg, format);
+        VPrintFormat(format, va_arg);
+        va_end(va_arg);
+    }
+
+    void FontContext::VPrintFormat(const char *format, std::va_list va_arg) {
         char char_buf[0x400];
+        util::VSNPrintf(char_buf, sizeof(char_buf), format, va_arg);
+
+        Print(char_buf);
+    }
 
+    const char *FontContext::LayoutString(GlyphRun *out_runs, size_t max_runs, size_t *out_num_runs, const char *str) {
+        std::scoped_lock lk(g_font_mutex);
+
+        TextLayoutState state = { .x = m_cur_x, .y = m_cur_y, .x_fraction = m_cur_x_fraction, .line_x = m_line_x, .first = true };
+
+        return LayoutGlyphRuns(out_runs, max_runs, out_num_runs, std::addressof(state), str, str + std::strlen(str), false);
+    }
+
+    void FontContext::DrawGlyphRuns(const GlyphRun *runs, size_t num_runs) {
+        std::scoped_lock lk(g_font_mutex);
+
+        return RasterizeGlyphRuns(runs, num_runs);
+    }
+
+    void FontContext::MeasureString(StringMetrics *out, const char *str) {
+        std::scoped_lock lk(g_font_mutex);
+
+        const char * const end = str + std::strlen(str);
+
+        /* Lay the string out from the origin, discarding the runs. */
+        TextLayoutState state = { .line_x = 0, .first = true };
+        GlyphRun runs[GlyphRunBatchCount];
+        while (str < end) {
+            size_t num_runs;
+            str = LayoutGlyphRuns(runs, util::size(runs), std::addressof(num_runs), std::addressof(state), str, end, false);
+        }
+
+        /* The height is how far PrintLine would move the pen down. */
+        *out = {
+            .width     = static_cast<u32>(std::ceil(state.max_width)),
+            .height    = static_cast<u32>(state.y + m_font_line_pixels),
+            .num_lines = state.num_newlines + 1,
+        };
+    }
+
+    void FontContext::MeasureFormat(StringMetrics *out, const char *format, ...) {
         std::va_list va_arg;
         va_start(va_arg, format);
+        VMeasureFormat(out, format, va_arg);
+        va_end(va_arg);
+    }
+
+    void FontContext::VMeasureFormat(StringMetrics *out, const char *format, std::va_list va_arg) {
+        char char_buf[0x400];
         util::VSNPrintf(char_buf, sizeof(char_buf), format, va_arg);
+
+        MeasureString(out, char_buf);
+    }
+
+    void FontContext::PrintMonospaceU64(u64 x) {
+        DrawHexDigits(x, 16);
+    }
+
+    void FontContext::PrintMonospaceU32(u32 x) {
+        DrawHexDigits(x, 8);
+    }
+
+    void FontContext::PrintMonospaceBlank(u32 width) {
+        std::scoped_lock lk(g_font_mutex);
+
+        TextEmitter text;
+        BeginText(std::addressof(text), true);
+        for (u32 i = 0; i < width; ++i) {
+            EmitCodepoint(std::addressof(text), ' ');
+        }
+        EndText(std::addressof(text), false);
+    }
+
+    float FontContext::GetKerningAdvance(u32 prev_char, u32 cur_char) {
+        std::scoped_lock lk(g_font_mutex);
+
+        return GetScaledKernAdvance(prev_char, cur_char);
+    }
+
+    void FontContext::SetSubpixelPositioningEnabled(bool enabled) {
+        m_subpixel_enabled = enabled;
+        m_cur_x_fraction = 0.0f;
+    }
+
+    FontContext &GetDefaultFontContext() {
+        return util::GetReference(g_default_context);
+    }
+
+    void PrintLine(const char *str) {
+        return GetDefaultFontContext().PrintLine(str);
+    }
+
+    void PrintFormatLine(const char *format, ...) {
+        std::va_list va_arg;
+        va_start(va_arg, format);
+        GetDefaultFontContext().VPrintFormatLine(format, va_arg);
         va_end(va_arg);
+    }
 
-        Print(char_buf);
+    void Print(const char *str) {
+        return GetDefaultFontContext().Print(str);
     }
 
-    void PrintMonospaceU64(u64 x) {
-        char char_buf[0x400];
-        util::SNPrintf(char_buf, sizeof(char_buf), "%016" PRIX64 "", x);
+    void PrintFormat(const char *format, ...) {
+        std::va_list va_arg;
+        va_start(va_arg, format);
+        GetDefaultFontContext().VPrintFormat(format, va_arg);
+        va_end(va_arg);
+    }
 
-        DrawString(char_buf, false, true);
+    const char *LayoutString(GlyphRun *out_runs, size_t max_runs, size_t *out_num_runs, const char *str) {
+        return GetDefaultFontContext().LayoutString(out_runs, max_runs, out_num_runs, str);
     }
 
-    void PrintMonospaceU32(u32 x) {
-        char char_buf[0x400];
-        util::SNPrintf(char_buf, sizeof(char_buf), "%08" PRIX32 "", x);
+    void DrawGlyphRuns(const GlyphRun *runs, size_t num_runs) {
+        return GetDefaultFontContext().DrawGlyphRuns(runs, num_runs);
+    }
+
+    void MeasureString(StringMetrics *out, const char *str) {
+        return GetDefaultFontContext().MeasureString(out, str);
+    }
+
+    void MeasureFormat(StringMetrics *out, const char *format, ...) {
+        std::va_list va_arg;
+        va_start(va_arg, format);
+        GetDefaultFontContext().VMeasureFormat(out, format, va_arg);
+        va_end(va_arg);
+    }
+
+    void PrintMonospaceU64(u64 x) {
+        return GetDefaultFontContext().PrintMonospaceU64(x);
+    }
 
-        DrawString(char_buf, false, true);
+    void PrintMonospaceU32(u32 x) {
+        return GetDefaultFontContext().PrintMonospaceU32(x);
     }
 
     void PrintMonospaceBlank(u32 width) {
-        char char_buf[0x400] = {0};
-        std::memset(char_buf, ' ', std::min(size_t(width), sizeof(char_buf)));
+        return GetDefaultFontContext().PrintMonospaceBlank(width);
+    }
+
+    void GetGlyphCacheStatistics(GlyphCacheStatistics *out) {
+        *out = g_glyph_cache_statistics;
+        out->file_num_glyphs = g_glyph_cache_file.GetRecordCount();
+        out->file_size       = g_glyph_cache_file.GetSize();
+    }
+
+    u32 GetGlyphIndex(u32 codepoint, size_t *out_face_index) {
+        std::scoped_lock lk(g_font_mutex);
+
+        if (!EnsureFontFaces()) {
+            *out_face_index = 0;
+            return 0;
+        }
+
+        const auto [face, glyph_index] = ResolveGlyph(codepoint);
+        *out_face_index = face - g_font_faces;
+        return glyph_index;
+    }
+
+    void SetCodepointPageTableEnabled(bool enabled) {
+        g_codepoint_page_table_enabled = enabled;
+    }
+
+    void SetCoverageRunsEnabled(bool enabled) {
+        g_coverage_runs_enabled = enabled;
+    }
+
+    void SetSpanRasterizationEnabled(bool enabled) {
+        g_span_rasterization_enabled = enabled;
+    }
+
+    void GetFontFaceStatistics(FontFaceStatistics *out) {
+        *out = g_font_face_statistics;
+    }
 
-        DrawString(char_buf, false, true);
+    void GetGlyphAtlasStatistics(GlyphAtlasStatistics *out) {
+        *out = g_atlas_statistics;
     }
 
     void SetFontColor(u16 color) {
-        g_font_color = color;
+        return GetDefaultFontContext().SetFontColor(color);
     }
 
     void SetPosition(u32 x, u32 y) {
-        g_line_x = x;
-        g_cur_x = x;
-        g_cur_y = y;
+        return GetDefaultFontContext().SetPosition(x, y);
     }
 
     u32 GetX() {
-        return g_cur_x;
+        return GetDefaultFontContext().GetX();
     }
 
     u32 GetY() {
-        return g_cur_y;
+        return GetDefaultFontContext().GetY();
     }
 
     void SetFontSize(float fsz) {
-        g_font_size = stbtt_ScaleForPixelHeight(std::addressof(g_stb_font), fsz * 1.375);
-
-        int ascent;
-        stbtt_GetFontVMetrics(std::addressof(g_stb_font), std::addressof(ascent),0,0);
-        g_font_line_pixels = ascent * g_font_size * 1.125;
+        return GetDefaultFontContext().SetFontSize(fsz);
+    }
 
-        int adv_width, left_side_bearing;
-        stbtt_GetCodepointHMetrics(std::addressof(g_stb_font), 'A', std::addressof(adv_width), std::addressof(left_side_bearing));
+    float GetKerningAdvance(u32 prev_char, u32 cur_char) {
+        return GetDefaultFontContext().GetKerningAdvance(prev_char, cur_char);
+    }
 
-        g_mono_adv = adv_width * g_font_size;
+    void SetKerningMatrixEnabled(bool enabled) {
+        return GetDefaultFontContext().SetKerningMatrixEnabled(enabled);
     }
 
     void AddSpacingLines(float num_lines) {
-        g_cur_x = g_line_x;
-        g_cur_y += static_cast<u32>(g_font_line_pixels * num_lines);
+        return GetDefaultFontContext().AddSpacingLines(num_lines);
+    }
+
+    void SetSubpixelPositioningEnabled(bool enabled) {
+        return GetDefaultFontContext().SetSubpixelPositioningEnabled(enabled);
+    }
+
+    void SetSignedDistanceFieldEnabled(bool enabled) {
+        return GetDefaultFontContext().SetSignedDistanceFieldEnabled(enabled);
+    }
+
+    RasterizerVersion GetRasterizerVersion() {
+        return GetDefaultFontContext().GetRasterizerVersion();
+    }
+
+    void SetRasterizerVersion(RasterizerVersion version) {
+        return GetDefaultFontContext().SetRasterizerVersion(version);
+    }
+
+    bool RasterizeGlyphBitmap(u8 *dst, size_t dst_size, s32 *out_width, s32 *out_height, u32 codepoint, float fsz, RasterizerVersion version) {
+        std::scoped_lock lk(g_font_mutex);
+
+        if (!EnsureFontFaces()) {
+            return false;
+        }
+
+        const float scale = GetScaleForFontSize(fsz);
+        GlyphMetrics metrics;
+        ComputeGlyphMetrics(std::addressof(metrics), codepoint, scale);
+
+        const s32 width = metrics.x1 - metrics.x0, height = metrics.y1 - metrics.y0;
+        if (static_cast<size_t>(width * height) > dst_size) {
+            return false;
+        }
+
+        RasterizeGlyph(dst, dst_size, codepoint, scale, version, nullptr, 0.0f, metrics.x0, metrics.y0, width, height);
+        *out_width  = width;
+        *out_height = height;
+        return true;
+    }
+
+    void GetSignedDistanceFieldStatistics(SignedDistanceFieldStatistics *out) {
+        *out = g_sdf_statistics;
+    }
+
+    void ConfigureFontFramebuffer(u16 *fb, u32 width, u32 height, u32 (*unswizzle_func)(u32, u32)) {
+        return GetDefaultFontContext().ConfigureFramebuffer(fb, width, height, unswizzle_func);
+    }
+
+    void PushClipRect(s32 x, s32 y, u32 width, u32 height) {
+        return GetDefaultFontContext().PushClipRect(x, y, width, height);
+    }
+
+    void PopClipRect() {
+        return GetDefaultFontContext().PopClipRect();
+    }
+
+    BlendKernel GetBlendKernel() {
+        return GetDefaultFontContext().GetBlendKernel();
+    }
+
+    void SetBlendKernel(BlendKernel kernel) {
+        return GetDefaultFontContext().SetBlendKernel(kernel);
     }
 
-    void ConfigureFontFramebuffer(u16 *fb, u32 (*unswizzle_func)(u32, u32)) {
-        g_frame_buffer = fb;
-        g_unswizzle_func = unswizzle_func;
+    void SetGlyphCacheFilePath(const char *path) {
+        std::free(g_glyph_cache_file_path);
+        g_glyph_cache_file_path = nullptr;
+
+        if (path != nullptr) {
+            const size_t path_size = std::strlen(path) + 1;
+            g_glyph_cache_file_path = static_cast<char *>(std::malloc(path_size));
+            AMS_ABORT_UNLESS(g_glyph_cache_file_path != nullptr);
+            std::memcpy(g_glyph_cache_file_path, path, path_size);
+        }
+    }
+
+    Result SaveGlyphCacheFile() {
+        AMS_ABORT_UNLESS(g_glyph_cache_file_path != nullptr);
+
+        std::scoped_lock lk(g_font_mutex);
+
+        /* Gather everything we know how to draw: what was already saved, the atlas, and the cache. */
+        const size_t max_glyphs = g_glyph_cache_file.GetRecordCount() + AtlasFontSizeCount * AtlasCodePointCount + GlyphCacheSetCount * GlyphCacheWayCount;
+        auto *glyphs = static_cast<GlyphCacheFileGlyph *>(std::malloc(max_glyphs * sizeof(GlyphCacheFileGlyph)));
+        AMS_ABORT_UNLESS(glyphs != nullptr);
+        ON_SCOPE_EXIT { std::free(glyphs); };
+
+        size_t num_glyphs = 0;
+        auto AddGlyph = [&](const GlyphBitmap &glyph, u32 codepoint, float scale, u32 phase, bool is_sdf, u8 rasterizer) {
+            glyphs[num_glyphs++] = {
+                .key      = MakeGlyphCacheFileKey(codepoint, scale, phase, is_sdf, rasterizer),
+                .data     = glyph.data,
+                .width    = glyph.width,
+                .height   = glyph.height,
+                .stride   = glyph.stride,
+                .x_offset = glyph.x_offset,
+                .y_offset = glyph.y_offset,
+            };
+        };
+
+        for (size_t i = 0; i < g_glyph_cache_file.GetRecordCount(); ++i) {
+            if (g_glyph_cache_file.GetGlyph(glyphs + num_glyphs, g_glyph_cache_file.GetRecord(i))) {
+                ++num_glyphs;
+            }
+        }
+
+        /* A compiled atlas is part of the binary already. */
+        if (g_atlas_statistics.num_glyphs != 0 && !g_atlas_statistics.is_compiled) {
+            for (const auto &atlas : g_atlases) {
+                for (size_t c = 0; c < AtlasCodePointCount; ++c) {
+                    AddGlyph(atlas.glyphs[c], AtlasFirstCodePoint + c, atlas.scale, 0, false, AtlasRasterizerVersion);
+                }
+            }
+        }
+
+        for (const auto &set : g_glyph_cache) {
+            for (const auto &entry : set) {
+                if (entry.valid) {
+                    AddGlyph(entry.glyph, entry.codepoint, entry.scale, entry.phase, entry.is_sdf, entry.rasterizer);
+                }
+            }
+        }
+
+        R_RETURN(GlyphCacheFile::Write(g_glyph_cache_file_path, g_font_hash, g_rasterizer_settings_hash, glyphs, num_glyphs));
     }
 
     Result InitializeSharedFont() {
-        const char *path = nullptr;
-        AMS_ABORT_UNLESS(CreateFilePath(std::addressof(path), "nintendo_udsg-r_std_003.ttf"));
-        ON_SCOPE_EXIT { std::free(const_cast<char *>(path)); };
+        g_rasterizer_settings_hash = ComputeRasterizerSettingsHash();
 
-        /* Open shared font file. */
-        fs::FileHandle file;
-        R_TRY(fs::OpenFile(std::addressof(file), path, fs::OpenMode_Read));
-        ON_SCOPE_EXIT { fs::CloseFile(file); };
+        /* A compiled atlas covers the fatal screen, so faces are left until something beyond it is drawn. */
+        #if !defined(ATMOSPHERE_FATAL_FONT_HAS_COMPILED_ATLAS)
+        R_TRY(LoadFontFaces());
+        #endif
 
-        s64 size;
-        R_TRY(fs::GetFileSize(std::addressof(size), file));
+        /* Set up persistent rasterization memory. */
+        g_rasterizer_arena.buffer = static_cast<u8 *>(AllocateForFont(RasterizerArenaSize));
+        g_rasterizer_arena.size   = g_rasterizer_arena.buffer != nullptr ? RasterizerArenaSize : 0;
 
-        /* Allocate font buffer. */
-        g_font_buffer = static_cast<u8 *>(std::malloc(size));
-        AMS_ABORT_UNLESS(g_font_buffer != nullptr);
+        g_glyph_cache_pixels = static_cast<u8 *>(AllocateForFont(GlyphCacheSetCount * GlyphCacheWayCount * GlyphCacheSlotSize));
+        AMS_ABORT_UNLESS(g_glyph_cache_pixels != nullptr);
 
-        /* Read the font buffer. */
-        R_TRY(fs::ReadFile(file, 0, g_font_buffer, size));
+        g_sdf_scale = GetScaleForFontSize(SdfReferenceFontSize);
 
-        stbtt_InitFont(std::addressof(g_stb_font), g_font_buffer, stbtt_GetFontOffsetForIndex(g_font_buffer, 0));
+        BuildGlyphAtlas();
+        EncodeGlyphAtlasCoverageRuns();
 
-        SetFontSize(16.0f);
+        util::ConstructAt(g_default_context);
         R_SUCCEED();
     }
 
@@ -15,6 +15,9 @@
  */
 #pragma once
 #include <stratosphere.hpp>
+#include "fatal_font_blend.hpp"
+#include "fatal_font_format.hpp"
+#include "fatal_font_heap.hpp"
 
 // HACK: put this elsewhere?
 namespace ams::fssrv::impl {
@@ -63,9 +66,218 @@ namespace ams::fatal::srv::font {
         return true;
     }
 
+    struct GlyphCacheStatistics {
+        u64 hits;
+        u64 misses;
+        u64 evictions;
+        size_t num_entries;
+        size_t bitmap_size;
+        u64 file_hits;
+        size_t file_num_glyphs;
+        size_t file_size;
+    };
+
+    struct FontFaceStatistics {
+        size_t num_faces;
+        size_t num_pages;
+        size_t page_table_size;
+        size_t num_fallback;
+        size_t num_missing;
+        u64 cmap_searches;
+    };
+
+    struct GlyphAtlasStatistics {
+        u32 width;
+        u32 height;
+        size_t memory_size;
+        size_t num_glyphs;
+        size_t coverage_runs_size;
+        s64 build_time_us;
+        bool is_compiled;
+        bool is_cached;
+    };
+
+    /* A glyph placed by the layout stage: x and y are the pen position its bitmap is drawn relative to. */
+    struct GlyphRun {
+        u32 codepoint;
+        s32 x;
+        s32 y;
+        float advance;
+        u8 phase;
+    };
+
+    /* Extents of a string as DrawString would lay it out from the start of a line, without drawing it. */
+    struct StringMetrics {
+        u32 width;
+        u32 height;
+        u32 num_lines;
+    };
+
+    struct SignedDistanceFieldStatistics {
+        size_t num_glyphs;
+        size_t memory_size;
+        u64 num_overflowed; /* Lookups drawn without a field because the table was full. */
+    };
+
+    /* stb_truetype's scanline rasterizers: version 1 oversamples each scanline, version 2 computes exact coverage. The fixed point rasterizer computes the same coverage without floating point. */
+    enum RasterizerVersion : u8 {
+        RasterizerVersion_1          = 1,
+        RasterizerVersion_2          = 2,
+        RasterizerVersion_FixedPoint = 3,
+    };
+
+    namespace impl {
+
+        struct GlyphBitmap;
+        struct GlyphMetrics;
+        struct GlyphAtlas;
+        struct GlyphMetricsTable;
+        struct CompiledFontSize;
+        struct TextLayoutState;
+        struct TextEmitter;
+
+    }
+
+    /* Everything needed to draw one frame: where to draw, how, and where the pen is. The font itself, and its caches, are shared by every context, so contexts draw one at a time. */
+    /* Each context holds its own blend table, which makes it too large for the stack. */
+    class FontContext {
+        NON_COPYABLE(FontContext);
+        NON_MOVEABLE(FontContext);
+        private:
+            /* Clip rectangles, with right and bottom exclusive. The bottom of the stack is the framebuffer itself. */
+            struct ClipRect {
+                s32 left;
+                s32 top;
+                s32 right;
+                s32 bottom;
+            };
+
+            static constexpr size_t ClipStackDepth = 8;
+        private:
+            u16 *m_frame_buffer;
+            u32 (*m_unswizzle_func)(u32, u32);
+            bool m_frame_buffer_is_linear;
+            ClipRect m_clip_stack[ClipStackDepth];
+            size_t m_clip_depth;
+            BlendKernel m_blend_kernel;
+            BlendSpanFunction m_blend_span;
+            u16 m_font_color;
+            BlendTable m_blend_table;
+            float m_font_line_pixels;
+            float m_font_size;
+            u32 m_line_x;
+            u32 m_cur_x;
+            u32 m_cur_y;
+            float m_cur_x_fraction;
+            u32 m_mono_adv;
+            const impl::GlyphAtlas *m_atlas;
+            const impl::CompiledFontSize *m_compiled_size;
+            impl::GlyphMetricsTable *m_metrics;
+            bool m_subpixel_enabled;
+            bool m_sdf_enabled;
+            bool m_kerning_matrix_enabled;
+            RasterizerVersion m_rasterizer_version;
+        public:
+            /* Contexts start out white at size 16, with the best blend kernel; the shared font must already be initialized. */
+            FontContext();
+
+            void ConfigureFramebuffer(u16 *fb, u32 width, u32 height, u32 (*unswizzle_func)(u32, u32));
+            void PushClipRect(s32 x, s32 y, u32 width, u32 height);
+            void PopClipRect();
+
+            BlendKernel GetBlendKernel() const { return m_blend_kernel; }
+            void SetBlendKernel(BlendKernel kernel);
+
+            void SetFontColor(u16 color);
+            void SetPosition(u32 x, u32 y);
+            u32 GetX() const { return m_cur_x; }
+            u32 GetY() const { return m_cur_y; }
+            void SetFontSize(float fsz);
+            void AddSpacingLines(float num_lines);
+
+            void PrintLine(const char *str);
+            void PrintFormatLine(const char *format, ...);
+            void VPrintFormatLine(const char *format, std::va_list va_arg);
+            void Print(const char *str);
+            void PrintFormat(const char *format, ...);
+            void VPrintFormat(const char *format, std::va_list va_arg);
+
+            /* Formatted text is laid out as it is formatted, without going through a string. */
+            template<typename... Args>
+            void Format(FormatString<Args...> format, Args &&... args) {
+                const impl::FormatArg format_args[] = { impl::MakeFormatArg(args)..., impl::FormatArg{} };
+                this->DrawFormat(format.Get(), format_args, false);
+            }
+
+            template<typename... Args>
+            void FormatLine(FormatString<Args...> format, Args &&... args) {
+                const impl::FormatArg format_args[] = { impl::MakeFormatArg(args)..., impl::FormatArg{} };
+                this->DrawFormat(format.Get(), format_args, true);
+            }
+
+            const char *LayoutString(GlyphRun *out_runs, size_t max_runs, size_t *out_num_runs, const char *str);
+            void DrawGlyphRuns(const GlyphRun *runs, size_t num_runs);
+
+            void MeasureString(StringMetrics *out, const char *str);
+            void MeasureFormat(StringMetrics *out, const char *format, ...);
+            void VMeasureFormat(StringMetrics *out, const char *format, std::va_list va_arg);
+
+            void PrintMonospaceU64(u64 x);
+            void PrintMonospaceU32(u32 x);
+            void PrintMonospaceBlank(u32 width);
+
+            float GetKerningAdvance(u32 prev_char, u32 cur_char);
+            void SetKerningMatrixEnabled(bool enabled) { m_kerning_matrix_enabled = enabled; }
+            void SetSubpixelPositioningEnabled(bool enabled);
+            void SetSignedDistanceFieldEnabled(bool enabled) { m_sdf_enabled = enabled; }
+
+            RasterizerVersion GetRasterizerVersion() const { return m_rasterizer_version; }
+            void SetRasterizerVersion(RasterizerVersion version) { m_rasterizer_version = version; }
+        private:
+            impl::GlyphMetrics GetGlyphMetrics(u32 codepoint);
+            void SelectGlyphMetricsTable();
+            float GetScaledKernAdvance(u32 prev_char, u32 cur_char);
+            /* Without rasterize_uncached, a glyph too large for the cache may come back with no data, to be drawn with DrawGlyphSpans. */
+            const impl::GlyphBitmap *GetGlyph(u32 codepoint, u32 phase = 0, bool rasterize_uncached = true);
+            bool IntersectsClip(s32 left, s32 top, s32 right, s32 bottom) const;
+            void DrawGlyph(const impl::GlyphBitmap *glyph, s32 glyph_x, s32 glyph_y);
+            void DrawGlyphCoverageRuns(const impl::GlyphBitmap *glyph, s32 glyph_x, s32 glyph_y);
+            void DrawGlyphSpans(const impl::GlyphBitmap *glyph, u32 codepoint, u32 phase, s32 glyph_x, s32 glyph_y);
+            void BlendCoverageSpan(s32 x, s32 y, const u8 *coverage, s32 count);
+            void BuildHexDigitTiles(impl::GlyphMetricsTable *table);
+            void DrawHexDigits(u64 value, size_t num_digits);
+            void LayoutCodepoint(GlyphRun *runs, size_t *num_runs, impl::TextLayoutState *state, u32 cur_char, bool mono);
+            const char *LayoutGlyphRuns(GlyphRun *runs, size_t max_runs, size_t *out_num_runs, impl::TextLayoutState *state, const char *str, const char *end, bool mono);
+            void RasterizeGlyphRuns(const GlyphRun *runs, size_t num_runs);
+            void BeginText(impl::TextEmitter *text, bool mono);
+            void EmitCodepoint(impl::TextEmitter *text, u32 codepoint);
+            size_t EmitString(impl::TextEmitter *text, const char *str, const char *end);
+            void EmitInteger(impl::TextEmitter *text, u64 magnitude, bool negative, const impl::FormatSpec &spec);
+            void EmitPadding(impl::TextEmitter *text, size_t length, const impl::FormatSpec &spec);
+            void EndText(impl::TextEmitter *text, bool add_line);
+            void DrawString(const char *str, bool add_line, bool mono = false);
+            void DrawFormat(const char *format, const impl::FormatArg *args, bool add_line);
+    };
+
     Result InitializeSharedFont();
-    void ConfigureFontFramebuffer(u16 *fb, u32 (*unswizzle_func)(u32, u32));
+
+    /* The free functions below draw with this context. */
+    FontContext &GetDefaultFontContext();
+
+    void ConfigureFontFramebuffer(u16 *fb, u32 width, u32 height, u32 (*unswizzle_func)(u32, u32));
     void SetHeapMemory(void *memory, size_t memory_size);
+    void GetHeapStatistics(FontHeapStatistics *out);
+
+    /* Glyphs saved to the cache file are reused by later runs with the same font; the path must be set before initialization. */
+    void SetGlyphCacheFilePath(const char *path);
+    Result SaveGlyphCacheFile();
+
+    /* Text is clipped to the intersection of every pushed rectangle and the framebuffer. */
+    void PushClipRect(s32 x, s32 y, u32 width, u32 height);
+    void PopClipRect();
+
+    BlendKernel GetBlendKernel();
+    void SetBlendKernel(BlendKernel kernel);
 
     void SetFontColor(u16 color);
     void SetPosition(u32 x, u32 y);
@@ -77,8 +289,46 @@ namespace ams::fatal::srv::font {
     void PrintFormatLine(const char *format, ...);
     void Print(const char *str);
     void PrintFormat(const char *format, ...);
+
+    template<typename... Args>
+    void Format(FormatString<Args...> format, Args &&... args) {
+        return GetDefaultFontContext().Format<Args...>(format, std::forward<Args>(args)...);
+    }
+
+    template<typename... Args>
+    void FormatLine(FormatString<Args...> format, Args &&... args) {
+        return GetDefaultFontContext().FormatLine<Args...>(format, std::forward<Args>(args)...);
+    }
+
+    /* Runs are laid out from the current position without moving it, and are only valid for the font size and modes in effect. */
+    /* Layout stops once max_runs are filled, returning where it stopped: the end of str only if the whole string fit. */
+    const char *LayoutString(GlyphRun *out_runs, size_t max_runs, size_t *out_num_runs, const char *str);
+    void DrawGlyphRuns(const GlyphRun *runs, size_t num_runs);
+
+    void MeasureString(StringMetrics *out, const char *str);
+    void MeasureFormat(StringMetrics *out, const char *format, ...);
+
     void PrintMonospaceU64(u64 x);
     void PrintMonospaceU32(u32 x);
     void PrintMonospaceBlank(u32 width);
 
+    float GetKerningAdvance(u32 prev_char, u32 cur_char);
+    void SetKerningMatrixEnabled(bool enabled);
+    u32 GetGlyphIndex(u32 codepoint, size_t *out_face_index);
+    void SetCodepointPageTableEnabled(bool enabled);
+    void SetCoverageRunsEnabled(bool enabled);
+    void SetSpanRasterizationEnabled(bool enabled);
+    void SetSubpixelPositioningEnabled(bool enabled);
+    void SetSignedDistanceFieldEnabled(bool enabled);
+    RasterizerVersion GetRasterizerVersion();
+    void SetRasterizerVersion(RasterizerVersion version);
+
+    /* Rasterizes a glyph straight into dst, bypassing every cache, so that rasterizers can be compared. Fails if dst is too small. */
+    bool RasterizeGlyphBitmap(u8 *dst, size_t dst_size, s32 *out_width, s32 *out_height, u32 codepoint, float fsz, RasterizerVersion version);
+
+    void GetGlyphCacheStatistics(GlyphCacheStatistics *out);
+    void GetFontFaceStatistics(FontFaceStatistics *out);
+    void GetGlyphAtlasStatistics(GlyphAtlasStatistics *out);
+    void GetSignedDistanceFieldStatistics(SignedDistanceFieldStatistics *out);
+
 }
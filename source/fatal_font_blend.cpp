@@ -0,0 +1,281 @@
+/*
+ * Copyright (c) Atmosphère-NX
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <stratosphere.hpp>
+#include "fatal_font_blend.hpp"
+
+#if defined(ATMOSPHERE_ARCH_X64)
+#include <immintrin.h>
+#elif defined(ATMOSPHERE_ARCH_ARM64)
+#include <arm_neon.h>
+#endif
+
+/* Define color conversion macros. */
+#define RGB888_TO_RGB565(r, g, b) ((((r >> 3) << 11) & 0xF800) | (((g >> 2) << 5) & 0x7E0) | ((b >> 3) & 0x1F))
+#define RGB565_GET_R8(c) ((((c >> 11) & 0x1F) << 3) | ((c >> 13) & 7))
+#define RGB565_GET_G8(c) ((((c >> 5) & 0x3F) << 2) | ((c >> 9) & 3))
+#define RGB565_GET_B8(c) ((((c >> 0) & 0x1F) << 3) | ((c >> 2) & 7))
+
+namespace ams::fatal::srv::font {
+
+    /* NOTE: The vector kernels divide by 0xFF as (x + 1 + (x >> 8)) >> 8, which is exact for every x <= 0xFF * 0xFF. */
+    /* They therefore produce bit-identical results to BlendPixel, which the benchmark verifies exhaustively. */
+
+    namespace {
+
+        void BlendSpanTable(u16 *dst, const u8 *coverage, size_t count, const BlendTable &table) {
+            for (size_t i = 0; i < count; ++i) {
+                dst[i] = BlendPixelWithTable(table, dst[i], coverage[i]);
+            }
+        }
+
+        void BlendSpanScalar(u16 *dst, const u8 *coverage, size_t count, const BlendTable &table) {
+            const u16 color = table.color;
+            for (size_t i = 0; i < count; ++i) {
+                dst[i] = BlendPixel(color, dst[i], coverage[i]);
+            }
+        }
+
+        #if defined(ATMOSPHERE_ARCH_X64)
+
+        __attribute__((target("sse2"))) void BlendSpanSse2(u16 *dst, const u8 *coverage, size_t count, const BlendTable &table) {
+            const u16 color = table.color;
+            const __m128i zero   = _mm_setzero_si128();
+            const __m128i max    = _mm_set1_epi16(0xFF);
+            const __m128i one    = _mm_set1_epi16(1);
+            const __m128i mask_5 = _mm_set1_epi16(0x1F);
+            const __m128i mask_6 = _mm_set1_epi16(0x3F);
+            const __m128i c_r    = _mm_set1_epi16(RGB565_GET_R8(color));
+            const __m128i c_g    = _mm_set1_epi16(RGB565_GET_G8(color));
+            const __m128i c_b    = _mm_set1_epi16(RGB565_GET_B8(color));
+
+            size_t i = 0;
+            for (/* ... */; i + 8 <= count; i += 8) {
+                const __m128i bg    = _mm_loadu_si128(reinterpret_cast<const __m128i *>(dst + i));
+                const __m128i alpha = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(coverage + i)), zero);
+                const __m128i inv   = _mm_sub_epi16(max, alpha);
+
+                /* Expand the background to 8-bit channels. */
+                const __m128i b_r5 = _mm_srli_epi16(bg, 11);
+                const __m128i b_g6 = _mm_and_si128(_mm_srli_epi16(bg, 5), mask_6);
+                const __m128i b_b5 = _mm_and_si128(bg, mask_5);
+                const __m128i b_r  = _mm_or_si128(_mm_slli_epi16(b_r5, 3), _mm_srli_epi16(b_r5, 2));
+                const __m128i b_g  = _mm_or_si128(_mm_slli_epi16(b_g6, 2), _mm_srli_epi16(b_g6, 4));
+                const __m128i b_b  = _mm_or_si128(_mm_slli_epi16(b_b5, 3), _mm_srli_epi16(b_b5, 2));
+
+                /* Blend, and divide by 0xFF. */
+                __m128i r = _mm_add_epi16(_mm_mullo_epi16(alpha, c_r), _mm_mullo_epi16(inv, b_r));
+                __m128i g = _mm_add_epi16(_mm_mullo_epi16(alpha, c_g), _mm_mullo_epi16(inv, b_g));
+                __m128i b = _mm_add_epi16(_mm_mullo_epi16(alpha, c_b), _mm_mullo_epi16(inv, b_b));
+                r = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(r, one), _mm_srli_epi16(r, 8)), 8);
+                g = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(g, one), _mm_srli_epi16(g, 8)), 8);
+                b = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(b, one), _mm_srli_epi16(b, 8)), 8);
+
+                /* Pack back to RGB565. */
+                const __m128i out = _mm_or_si128(_mm_or_si128(_mm_slli_epi16(_mm_srli_epi16(r, 3), 11), _mm_slli_epi16(_mm_srli_epi16(g, 2), 5)), _mm_srli_epi16(b, 3));
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), out);
+            }
+
+            BlendSpanTable(dst + i, coverage + i, count - i, table);
+        }
+
+        __attribute__((target("avx2"))) void BlendSpanAvx2(u16 *dst, const u8 *coverage, size_t count, const BlendTable &table) {
+            const u16 color = table.color;
+            const __m256i max    = _mm256_set1_epi16(0xFF);
+            const __m256i one    = _mm256_set1_epi16(1);
+            const __m256i mask_5 = _mm256_set1_epi16(0x1F);
+            const __m256i mask_6 = _mm256_set1_epi16(0x3F);
+            const __m256i c_r    = _mm256_set1_epi16(RGB565_GET_R8(color));
+            const __m256i c_g    = _mm256_set1_epi16(RGB565_GET_G8(color));
+            const __m256i c_b    = _mm256_set1_epi16(RGB565_GET_B8(color));
+
+            size_t i = 0;
+            for (/* ... */; i + 16 <= count; i += 16) {
+                const __m256i bg    = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(dst + i));
+                const __m256i alpha = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(coverage + i)));
+                const __m256i inv   = _mm256_sub_epi16(max, alpha);
+
+                /* Expand the background to 8-bit channels. */
+                const __m256i b_r5 = _mm256_srli_epi16(bg, 11);
+                const __m256i b_g6 = _mm256_and_si256(_mm256_srli_epi16(bg, 5), mask_6);
+                const __m256i b_b5 = _mm256_and_si256(bg, mask_5);
+                const __m256i b_r  = _mm256_or_si256(_mm256_slli_epi16(b_r5, 3), _mm256_srli_epi16(b_r5, 2));
+                const __m256i b_g  = _mm256_or_si256(_mm256_slli_epi16(b_g6, 2), _mm256_srli_epi16(b_g6, 4));
+                const __m256i b_b  = _mm256_or_si256(_mm256_slli_epi16(b_b5, 3), _mm256_srli_epi16(b_b5, 2));
+
+                /* Blend, and divide by 0xFF. */
+                __m256i r = _mm256_add_epi16(_mm256_mullo_epi16(alpha, c_r), _mm256_mullo_epi16(inv, b_r));
+                __m256i g = _mm256_add_epi16(_mm256_mullo_epi16(alpha, c_g), _mm256_mullo_epi16(inv, b_g));
+                __m256i b = _mm256_add_epi16(_mm256_mullo_epi16(alpha, c_b), _mm256_mullo_epi16(inv, b_b));
+                r = _mm256_srli_epi16(_mm256_add_epi16(_mm256_add_epi16(r, one), _mm256_srli_epi16(r, 8)), 8);
+                g = _mm256_srli_epi16(_mm256_add_epi16(_mm256_add_epi16(g, one), _mm256_srli_epi16(g, 8)), 8);
+                b = _mm256_srli_epi16(_mm256_add_epi16(_mm256_add_epi16(b, one), _mm256_srli_epi16(b, 8)), 8);
+
+                /* Pack back to RGB565. */
+                const __m256i out = _mm256_or_si256(_mm256_or_si256(_mm256_slli_epi16(_mm256_srli_epi16(r, 3), 11), _mm256_slli_epi16(_mm256_srli_epi16(g, 2), 5)), _mm256_srli_epi16(b, 3));
+                _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i), out);
+            }
+
+            /* Finish with the narrower kernel, then the scalar tail. */
+            BlendSpanSse2(dst + i, coverage + i, count - i, table);
+        }
+
+        #elif defined(ATMOSPHERE_ARCH_ARM64)
+
+        void BlendSpanNeon(u16 *dst, const u8 *coverage, size_t count, const BlendTable &table) {
+            const u16 color = table.color;
+            const uint16x8_t max    = vdupq_n_u16(0xFF);
+            const uint16x8_t one    = vdupq_n_u16(1);
+            const uint16x8_t mask_5 = vdupq_n_u16(0x1F);
+            const uint16x8_t mask_6 = vdupq_n_u16(0x3F);
+            const uint16x8_t c_r    = vdupq_n_u16(RGB565_GET_R8(color));
+            const uint16x8_t c_g    = vdupq_n_u16(RGB565_GET_G8(color));
+            const uint16x8_t c_b    = vdupq_n_u16(RGB565_GET_B8(color));
+
+            size_t i = 0;
+            for (/* ... */; i + 8 <= count; i += 8) {
+                const uint16x8_t bg    = vld1q_u16(dst + i);
+                const uint16x8_t alpha = vmovl_u8(vld1_u8(coverage + i));
+                const uint16x8_t inv   = vsubq_u16(max, alpha);
+
+                /* Expand the background to 8-bit channels. */
+                const uint16x8_t b_r5 = vshrq_n_u16(bg, 11);
+                const uint16x8_t b_g6 = vandq_u16(vshrq_n_u16(bg, 5), mask_6);
+                const uint16x8_t b_b5 = vandq_u16(bg, mask_5);
+                const uint16x8_t b_r  = vorrq_u16(vshlq_n_u16(b_r5, 3), vshrq_n_u16(b_r5, 2));
+                const uint16x8_t b_g  = vorrq_u16(vshlq_n_u16(b_g6, 2), vshrq_n_u16(b_g6, 4));
+                const uint16x8_t b_b  = vorrq_u16(vshlq_n_u16(b_b5, 3), vshrq_n_u16(b_b5, 2));
+
+                /* Blend, and divide by 0xFF. */
+                uint16x8_t r = vmlaq_u16(vmulq_u16(alpha, c_r), inv, b_r);
+                uint16x8_t g = vmlaq_u16(vmulq_u16(alpha, c_g), inv, b_g);
+                uint16x8_t b = vmlaq_u16(vmulq_u16(alpha, c_b), inv, b_b);
+                r = vshrq_n_u16(vaddq_u16(vaddq_u16(r, one), vshrq_n_u16(r, 8)), 8);
+                g = vshrq_n_u16(vaddq_u16(vaddq_u16(g, one), vshrq_n_u16(g, 8)), 8);
+                b = vshrq_n_u16(vaddq_u16(vaddq_u16(b, one), vshrq_n_u16(b, 8)), 8);
+
+                /* Pack back to RGB565. */
+                const uint16x8_t out = vorrq_u16(vorrq_u16(vshlq_n_u16(vshrq_n_u16(r, 3), 11), vshlq_n_u16(vshrq_n_u16(g, 2), 5)), vshrq_n_u16(b, 3));
+                vst1q_u16(dst + i, out);
+            }
+
+            BlendSpanTable(dst + i, coverage + i, count - i, table);
+        }
+
+        #endif
+
+    }
+
+    u16 BlendPixel(u16 color, u16 bg, u8 alpha) {
+        const u32 c_r = RGB565_GET_R8(color);
+        const u32 c_g = RGB565_GET_G8(color);
+        const u32 c_b = RGB565_GET_B8(color);
+        const u32 b_r = RGB565_GET_R8(bg);
+        const u32 b_g = RGB565_GET_G8(bg);
+        const u32 b_b = RGB565_GET_B8(bg);
+
+        const u32 r = ((alpha * c_r) + ((0xFF - alpha) * b_r)) / 0xFF;
+        const u32 g = ((alpha * c_g) + ((0xFF - alpha) * b_g)) / 0xFF;
+        const u32 b = ((alpha * c_b) + ((0xFF - alpha) * b_b)) / 0xFF;
+
+        return RGB888_TO_RGB565(r, g, b);
+    }
+
+    void BuildBlendTable(BlendTable *out, u16 color) {
+        const u32 c_r = RGB565_GET_R8(color);
+        const u32 c_g = RGB565_GET_G8(color);
+        const u32 c_b = RGB565_GET_B8(color);
+
+        for (u32 alpha = 0; alpha <= 0xFF; ++alpha) {
+            for (u32 v = 0; v < 0x20; ++v) {
+                const u32 b_8 = (v << 3) | (v >> 2);
+                out->r[alpha][v] = (((alpha * c_r) + ((0xFF - alpha) * b_8)) / 0xFF) >> 3;
+                out->b[alpha][v] = (((alpha * c_b) + ((0xFF - alpha) * b_8)) / 0xFF) >> 3;
+            }
+            for (u32 v = 0; v < 0x40; ++v) {
+                const u32 b_8 = (v << 2) | (v >> 4);
+                out->g[alpha][v] = (((alpha * c_g) + ((0xFF - alpha) * b_8)) / 0xFF) >> 2;
+            }
+        }
+
+        out->color = color;
+    }
+
+    u16 BlendPixelWithTable(const BlendTable &table, u16 bg, u8 alpha) {
+        return (table.r[alpha][bg >> 11] << 11) + (table.g[alpha][(bg >> 5) & 0x3F] << 5) + table.b[alpha][bg & 0x1F];
+    }
+
+    bool IsBlendKernelSupported(BlendKernel kernel) {
+        switch (kernel) {
+            case BlendKernel_Scalar:
+            case BlendKernel_Table:
+                return true;
+            #if defined(ATMOSPHERE_ARCH_X64)
+            case BlendKernel_Sse2:
+                return true;
+            case BlendKernel_Avx2:
+                return __builtin_cpu_supports("avx2");
+            #elif defined(ATMOSPHERE_ARCH_ARM64)
+            case BlendKernel_Neon:
+                return true;
+            #endif
+            default:
+                return false;
+        }
+    }
+
+    BlendKernel SelectBlendKernel() {
+        /* Prefer the widest supported kernel, and otherwise avoid per-pixel division. */
+        for (const auto kernel : { BlendKernel_Avx2, BlendKernel_Neon, BlendKernel_Sse2 }) {
+            if (IsBlendKernelSupported(kernel)) {
+                return kernel;
+            }
+        }
+
+        return BlendKernel_Table;
+    }
+
+    BlendSpanFunction GetBlendSpanFunction(BlendKernel kernel) {
+        AMS_ASSERT(IsBlendKernelSupported(kernel));
+
+        switch (kernel) {
+            #if defined(ATMOSPHERE_ARCH_X64)
+            case BlendKernel_Sse2:
+                return BlendSpanSse2;
+            case BlendKernel_Avx2:
+                return BlendSpanAvx2;
+            #elif defined(ATMOSPHERE_ARCH_ARM64)
+            case BlendKernel_Neon:
+                return BlendSpanNeon;
+            #endif
+            case BlendKernel_Table:
+                return BlendSpanTable;
+            default:
+                return BlendSpanScalar;
+        }
+    }
+
+    const char *GetBlendKernelName(BlendKernel kernel) {
+        switch (kernel) {
+            case BlendKernel_Scalar: return "scalar";
+            case BlendKernel_Sse2:   return "sse2";
+            case BlendKernel_Avx2:   return "avx2";
+            case BlendKernel_Neon:   return "neon";
+            case BlendKernel_Table:  return "table";
+            default:                 return "unknown";
+        }
+    }
+
+}
@@ -0,0 +1,52 @@
+/*
+ * Copyright (c) Atmosphère-NX
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+#include <stratosphere.hpp>
+
+namespace ams::fatal::srv::font {
+
+    enum BlendKernel {
+        BlendKernel_Scalar,
+        BlendKernel_Sse2,
+        BlendKernel_Avx2,
+        BlendKernel_Neon,
+        BlendKernel_Table,
+
+        BlendKernel_Count,
+    };
+
+    /* Per-alpha, per-background-channel results for one color, already reduced to RGB565 channel width. */
+    struct BlendTable {
+        u16 color;
+        u8 r[0x100][0x20];
+        u8 g[0x100][0x40];
+        u8 b[0x100][0x20];
+    };
+
+    /* Blends count pixels of coverage (used as alpha) in the table's color over dst, which must be contiguous. */
+    using BlendSpanFunction = void (*)(u16 *dst, const u8 *coverage, size_t count, const BlendTable &table);
+
+    u16 BlendPixel(u16 color, u16 bg, u8 alpha);
+
+    void BuildBlendTable(BlendTable *out, u16 color);
+    u16 BlendPixelWithTable(const BlendTable &table, u16 bg, u8 alpha);
+
+    bool IsBlendKernelSupported(BlendKernel kernel);
+    BlendKernel SelectBlendKernel();
+    BlendSpanFunction GetBlendSpanFunction(BlendKernel kernel);
+    const char *GetBlendKernelName(BlendKernel kernel);
+
+}
@@ -0,0 +1,288 @@
+/*
+ * Copyright (c) Atmosphère-NX
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <stratosphere.hpp>
+#include "fatal_font_cache_file.hpp"
+
+#if defined(ATMOSPHERE_OS_LINUX) || defined(ATMOSPHERE_OS_MACOS)
+#include <cstdio>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define ATMOSPHERE_FATAL_FONT_CAN_MAP_FILE
+#endif
+
+namespace ams::fatal::srv::font {
+
+    namespace {
+
+        constexpr u32 GlyphCacheFileMagic = util::FourCC<'F','G','C','F'>::Code;
+        constexpr u32 GlyphCacheFileVersion = 3;
+
+        struct GlyphCacheFileHeader {
+            u32 magic;
+            u32 version;
+            u64 font_hash;
+            u64 settings_hash;
+            u64 file_size;
+            u32 num_records;
+            u32 pixels_offset;
+        };
+        static_assert(sizeof(GlyphCacheFileHeader) == 0x28);
+
+        Result ReadWholeFile(const u8 **out, size_t *out_size, const char *path) {
+            fs::FileHandle file;
+            R_TRY(fs::OpenFile(std::addressof(file), path, fs::OpenMode_Read));
+            ON_SCOPE_EXIT { fs::CloseFile(file); };
+
+            s64 size;
+            R_TRY(fs::GetFileSize(std::addressof(size), file));
+
+            u8 *buffer = static_cast<u8 *>(std::malloc(size));
+            AMS_ABORT_UNLESS(buffer != nullptr);
+
+            if (const Result res = fs::ReadFile(file, 0, buffer, size); R_FAILED(res)) {
+                std::free(buffer);
+                R_RETURN(res);
+            }
+
+            *out      = buffer;
+            *out_size = size;
+            R_SUCCEED();
+        }
+
+        Result ReplaceFile(const char *tmp_path, const char *path) {
+            #if defined(ATMOSPHERE_FATAL_FONT_CAN_MAP_FILE)
+            {
+                /* rename() replaces the destination atomically, so readers see either the old file or the new one. */
+                if (std::rename(tmp_path, path) == 0) {
+                    R_SUCCEED();
+                }
+            }
+            #endif
+
+            /* Otherwise, the old file has to go first. */
+            fs::DeleteFile(path);
+            R_RETURN(fs::RenameFile(tmp_path, path));
+        }
+
+    }
+
+    u64 HashGlyphCacheFileData(const void *data, size_t size, u64 hash) {
+        /* FNV-1a. */
+        const u8 *bytes = static_cast<const u8 *>(data);
+        for (size_t i = 0; i < size; ++i) {
+            hash = (hash ^ bytes[i]) * 0x100000001B3ull;
+        }
+        return hash;
+    }
+
+    bool MapReadOnlyFile(const u8 **out, size_t *out_size, const char *path) {
+        #if defined(ATMOSPHERE_FATAL_FONT_CAN_MAP_FILE)
+        {
+            const int fd = ::open(path, O_RDONLY | O_CLOEXEC);
+            if (fd < 0) {
+                return false;
+            }
+            ON_SCOPE_EXIT { ::close(fd); };
+
+            struct stat st;
+            if (::fstat(fd, std::addressof(st)) != 0 || st.st_size <= 0) {
+                return false;
+            }
+
+            /* The mapping outlives the descriptor, and its pages are shared with every other process mapping the file. */
+            void *mapped = ::mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapped == MAP_FAILED) {
+                return false;
+            }
+
+            *out      = static_cast<const u8 *>(mapped);
+            *out_size = st.st_size;
+            return true;
+        }
+        #else
+        {
+            AMS_UNUSED(out, out_size, path);
+            return false;
+        }
+        #endif
+    }
+
+    void UnmapReadOnlyFile(const u8 *data, size_t size) {
+        #if defined(ATMOSPHERE_FATAL_FONT_CAN_MAP_FILE)
+        {
+            ::munmap(const_cast<u8 *>(data), size);
+        }
+        #else
+        {
+            AMS_UNUSED(data, size);
+        }
+        #endif
+    }
+
+    bool GlyphCacheFile::Open(const char *path, u64 font_hash, u64 settings_hash) {
+        AMS_ABORT_UNLESS(!this->IsOpen());
+
+        /* Map the file where we can, or read it in otherwise. */
+        const u8 *data;
+        size_t size;
+        bool is_mapped = MapReadOnlyFile(std::addressof(data), std::addressof(size), path);
+        if (!is_mapped && R_FAILED(ReadWholeFile(std::addressof(data), std::addressof(size), path))) {
+            return false;
+        }
+
+        /* Anything stale, truncated or out of order is rejected here; records' pixels are bounds checked when used. */
+        const auto *header = reinterpret_cast<const GlyphCacheFileHeader *>(data);
+        bool valid = size >= sizeof(*header) && header->magic == GlyphCacheFileMagic && header->version == GlyphCacheFileVersion &&
+                     header->font_hash == font_hash && header->settings_hash == settings_hash && header->file_size == size &&
+                     header->pixels_offset >= sizeof(*header) + header->num_records * sizeof(GlyphCacheFileRecord) && header->pixels_offset <= size &&
+                     util::IsAligned(header->pixels_offset, alignof(GlyphCacheFileRecord));
+
+        /* Find binary searches the records, so they must be strictly sorted by key. */
+        if (valid) {
+            const auto *records = reinterpret_cast<const GlyphCacheFileRecord *>(data + sizeof(*header));
+            for (size_t i = 1; i < header->num_records && valid; ++i) {
+                valid = records[i - 1].key < records[i].key;
+            }
+        }
+
+        if (!valid) {
+            if (is_mapped) {
+                UnmapReadOnlyFile(data, size);
+            } else {
+                std::free(const_cast<u8 *>(data));
+            }
+            return false;
+        }
+
+        m_data        = data;
+        m_size        = size;
+        m_is_mapped   = is_mapped;
+        m_records     = reinterpret_cast<const GlyphCacheFileRecord *>(data + sizeof(*header));
+        m_num_records = header->num_records;
+        m_pixels      = data + header->pixels_offset;
+        m_pixels_size = size - header->pixels_offset;
+        return true;
+    }
+
+    void GlyphCacheFile::Close() {
+        if (m_is_mapped) {
+            UnmapReadOnlyFile(m_data, m_size);
+        } else {
+            std::free(const_cast<u8 *>(m_data));
+        }
+
+        m_data        = nullptr;
+        m_size        = 0;
+        m_is_mapped   = false;
+        m_records     = nullptr;
+        m_num_records = 0;
+        m_pixels      = nullptr;
+        m_pixels_size = 0;
+    }
+
+    const GlyphCacheFileRecord *GlyphCacheFile::Find(const GlyphCacheFileKey &key) const {
+        /* Records are sorted by key. */
+        const GlyphCacheFileRecord *end = m_records + m_num_records;
+        const GlyphCacheFileRecord *it  = std::lower_bound(m_records, end, key, [](const GlyphCacheFileRecord &record, const GlyphCacheFileKey &key) { return record.key < key; });
+        return (it != end && it->key == key) ? it : nullptr;
+    }
+
+    bool GlyphCacheFile::GetGlyph(GlyphCacheFileGlyph *out, const GlyphCacheFileRecord *record) const {
+        const size_t size = static_cast<size_t>(record->width) * record->height;
+        if (record->data_offset > m_pixels_size || size > m_pixels_size - record->data_offset) {
+            return false;
+        }
+
+        *out = {
+            .key      = record->key,
+            .data     = m_pixels + record->data_offset,
+            .width    = record->width,
+            .height   = record->height,
+            .stride   = record->width,
+            .x_offset = record->x_offset,
+            .y_offset = record->y_offset,
+        };
+        return true;
+    }
+
+    Result GlyphCacheFile::Write(const char *path, u64 font_hash, u64 settings_hash, GlyphCacheFileGlyph *glyphs, size_t num_glyphs) {
+        /* Sort the glyphs by key, keeping the first of any duplicates. */
+        std::stable_sort(glyphs, glyphs + num_glyphs, [](const GlyphCacheFileGlyph &lhs, const GlyphCacheFileGlyph &rhs) { return lhs.key < rhs.key; });
+        num_glyphs = std::unique(glyphs, glyphs + num_glyphs, [](const GlyphCacheFileGlyph &lhs, const GlyphCacheFileGlyph &rhs) { return lhs.key == rhs.key; }) - glyphs;
+
+        /* Lay the file out in memory, so that it can be written in one go. */
+        const size_t pixels_offset = sizeof(GlyphCacheFileHeader) + num_glyphs * sizeof(GlyphCacheFileRecord);
+        size_t file_size = pixels_offset;
+        for (size_t i = 0; i < num_glyphs; ++i) {
+            file_size += glyphs[i].width * glyphs[i].height;
+        }
+
+        u8 *buffer = static_cast<u8 *>(std::malloc(file_size));
+        AMS_ABORT_UNLESS(buffer != nullptr);
+        ON_SCOPE_EXIT { std::free(buffer); };
+
+        *reinterpret_cast<GlyphCacheFileHeader *>(buffer) = {
+            .magic         = GlyphCacheFileMagic,
+            .version       = GlyphCacheFileVersion,
+            .font_hash     = font_hash,
+            .settings_hash = settings_hash,
+            .file_size     = file_size,
+            .num_records   = static_cast<u32>(num_glyphs),
+            .pixels_offset = static_cast<u32>(pixels_offset),
+        };
+
+        auto *records = reinterpret_cast<GlyphCacheFileRecord *>(buffer + sizeof(GlyphCacheFileHeader));
+        size_t data_offset = 0;
+        for (size_t i = 0; i < num_glyphs; ++i) {
+            const auto &glyph = glyphs[i];
+            records[i] = {
+                .key         = glyph.key,
+                .x_offset    = static_cast<s16>(glyph.x_offset),
+                .y_offset    = static_cast<s16>(glyph.y_offset),
+                .width       = static_cast<u16>(glyph.width),
+                .height      = static_cast<u16>(glyph.height),
+                .data_offset = static_cast<u32>(data_offset),
+            };
+
+            for (s32 y = 0; y < glyph.height; ++y) {
+                std::memcpy(buffer + pixels_offset + data_offset + y * glyph.width, glyph.data + y * glyph.stride, glyph.width);
+            }
+            data_offset += glyph.width * glyph.height;
+        }
+
+        /* Write to a temporary file, and only replace the cache once it is complete. */
+        const size_t tmp_path_size = std::strlen(path) + sizeof(".tmp");
+        char *tmp_path = static_cast<char *>(std::malloc(tmp_path_size));
+        AMS_ABORT_UNLESS(tmp_path != nullptr);
+        ON_SCOPE_EXIT { std::free(tmp_path); };
+        util::SNPrintf(tmp_path, tmp_path_size, "%s.tmp", path);
+
+        fs::DeleteFile(tmp_path);
+        R_TRY(fs::CreateFile(tmp_path, file_size));
+        {
+            fs::FileHandle file;
+            R_TRY(fs::OpenFile(std::addressof(file), tmp_path, fs::OpenMode_Write));
+            ON_SCOPE_EXIT { fs::CloseFile(file); };
+
+            R_TRY(fs::WriteFile(file, 0, buffer, file_size, fs::WriteOption::Flush));
+        }
+
+        R_RETURN(ReplaceFile(tmp_path, path));
+    }
+
+}
@@ -0,0 +1,107 @@
+/*
+ * Copyright (c) Atmosphère-NX
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+#include <stratosphere.hpp>
+
+namespace ams::fatal::srv::font {
+
+    /* Identifies a rasterized glyph: what was drawn, at what scale, and how. */
+    struct GlyphCacheFileKey {
+        u32 codepoint;
+        u32 scale_bits;
+        u8 phase;
+        u8 is_sdf;
+        u8 rasterizer;
+        u8 reserved[1];
+
+        constexpr bool operator==(const GlyphCacheFileKey &rhs) const {
+            return codepoint == rhs.codepoint && scale_bits == rhs.scale_bits && phase == rhs.phase && is_sdf == rhs.is_sdf && rasterizer == rhs.rasterizer;
+        }
+
+        constexpr bool operator<(const GlyphCacheFileKey &rhs) const {
+            if (codepoint != rhs.codepoint) {
+                return codepoint < rhs.codepoint;
+            } else if (scale_bits != rhs.scale_bits) {
+                return scale_bits < rhs.scale_bits;
+            } else if (phase != rhs.phase) {
+                return phase < rhs.phase;
+            } else if (is_sdf != rhs.is_sdf) {
+                return is_sdf < rhs.is_sdf;
+            } else {
+                return rasterizer < rhs.rasterizer;
+            }
+        }
+    };
+    static_assert(sizeof(GlyphCacheFileKey) == 0xC);
+
+    struct GlyphCacheFileRecord {
+        GlyphCacheFileKey key;
+        s16 x_offset;
+        s16 y_offset;
+        u16 width;
+        u16 height;
+        u32 data_offset;
+    };
+    static_assert(sizeof(GlyphCacheFileRecord) == 0x18);
+
+    /* A glyph to write out, whose rows are stride bytes apart. */
+    struct GlyphCacheFileGlyph {
+        GlyphCacheFileKey key;
+        const u8 *data;
+        s32 width;
+        s32 height;
+        s32 stride;
+        s32 x_offset;
+        s32 y_offset;
+    };
+
+    u64 HashGlyphCacheFileData(const void *data, size_t size, u64 hash = 0xCBF29CE484222325ull);
+
+    /* Maps a file read-only, where the host supports it. */
+    bool MapReadOnlyFile(const u8 **out, size_t *out_size, const char *path);
+    void UnmapReadOnlyFile(const u8 *data, size_t size);
+
+    /* Rasterized glyphs saved by a previous run, used in place from a read-only mapping of the file. */
+    class GlyphCacheFile {
+        NON_COPYABLE(GlyphCacheFile);
+        NON_MOVEABLE(GlyphCacheFile);
+        private:
+            const u8 *m_data;
+            size_t m_size;
+            bool m_is_mapped;
+            const GlyphCacheFileRecord *m_records;
+            size_t m_num_records;
+            const u8 *m_pixels;
+            size_t m_pixels_size;
+        public:
+            constexpr GlyphCacheFile() : m_data(nullptr), m_size(0), m_is_mapped(false), m_records(nullptr), m_num_records(0), m_pixels(nullptr), m_pixels_size(0) { /* ... */ }
+
+            bool Open(const char *path, u64 font_hash, u64 settings_hash);
+            void Close();
+
+            bool IsOpen() const { return m_data != nullptr; }
+            size_t GetSize() const { return m_size; }
+            size_t GetRecordCount() const { return m_num_records; }
+            const GlyphCacheFileRecord *GetRecord(size_t index) const { return m_records + index; }
+
+            const GlyphCacheFileRecord *Find(const GlyphCacheFileKey &key) const;
+            bool GetGlyph(GlyphCacheFileGlyph *out, const GlyphCacheFileRecord *record) const;
+
+            /* Writes glyphs to a temporary file and renames it over path; for duplicate keys, the first glyph wins. */
+            static Result Write(const char *path, u64 font_hash, u64 settings_hash, GlyphCacheFileGlyph *glyphs, size_t num_glyphs);
+    };
+
+}
@@ -0,0 +1,186 @@
+/*
+ * Copyright (c) Atmosphère-NX
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+#include <stratosphere.hpp>
+
+namespace ams::fatal::srv::font {
+
+    namespace impl {
+
+        enum FormatArgType : u8 {
+            FormatArgType_Signed,
+            FormatArgType_Unsigned,
+            FormatArgType_Char,
+            FormatArgType_String,
+        };
+
+        /* An argument captured with its type, so that drawing it needs no vararg parsing. */
+        struct FormatArg {
+            FormatArgType type;
+            u8 size;
+            union {
+                s64 s;
+                u64 u;
+                u32 c;
+                const char *str;
+            };
+        };
+
+        /* A replacement field, {} or {:[0][width][type]}, where type is one of d, x, X, c or s. */
+        /* Numbers are right aligned and may be zero padded, while characters (including integers drawn with c) and strings are left aligned. */
+        struct FormatSpec {
+            char type;
+            u8 width;
+            bool zero_pad;
+        };
+
+        constexpr u32 FormatWidthMax = 64;
+
+        template<typename T>
+        consteval FormatArgType GetFormatArgType() {
+            using U = std::decay_t<T>;
+            static_assert(!std::is_same_v<U, bool>, "bool is not a format argument");
+            static_assert(std::is_integral_v<U> || std::is_convertible_v<U, const char *>, "unsupported format argument type");
+
+            if constexpr (std::is_same_v<U, char>) {
+                return FormatArgType_Char;
+            } else if constexpr (std::is_integral_v<U>) {
+                return std::is_signed_v<U> ? FormatArgType_Signed : FormatArgType_Unsigned;
+            } else {
+                return FormatArgType_String;
+            }
+        }
+
+        template<typename T>
+        ALWAYS_INLINE FormatArg MakeFormatArg(const T &value) {
+            constexpr FormatArgType Type = GetFormatArgType<T>();
+
+            FormatArg arg = {};
+            arg.type = Type;
+            if constexpr (Type == FormatArgType_Signed) {
+                /* Negative numbers are drawn in hex as two's complement of this size. */
+                arg.size = sizeof(T);
+                arg.s    = value;
+            } else if constexpr (Type == FormatArgType_Unsigned) {
+                arg.u = value;
+            } else if constexpr (Type == FormatArgType_Char) {
+                arg.c = static_cast<u8>(value);
+            } else {
+                arg.str = value;
+            }
+            return arg;
+        }
+
+        /* Parses the replacement field following a '{', returning where it ends, or nullptr if it is malformed. */
+        constexpr const char *ParseFormatSpec(FormatSpec *out, const char *str) {
+            *out = { .type = '\0', .width = 0, .zero_pad = false };
+            if (*str == ':') {
+                ++str;
+                if (*str == '0') {
+                    out->zero_pad = true;
+                    ++str;
+                }
+
+                u32 width = 0;
+                for (/* ... */; '0' <= *str && *str <= '9'; ++str) {
+                    if ((width = width * 10 + (*str - '0')) > FormatWidthMax) {
+                        return nullptr;
+                    }
+                }
+                out->width = width;
+
+                if (*str == 'd' || *str == 'x' || *str == 'X' || *str == 'c' || *str == 's') {
+                    out->type = *(str++);
+                }
+            }
+
+            return *str == '}' ? str + 1 : nullptr;
+        }
+
+        constexpr bool IsFormatSpecValidFor(const FormatSpec &spec, FormatArgType type) {
+            const bool is_integer = type == FormatArgType_Signed || type == FormatArgType_Unsigned;
+            if (spec.zero_pad && (!is_integer || spec.type == 'c')) {
+                return false;
+            }
+
+            switch (spec.type) {
+                case 'd':
+                case 'x':
+                case 'X':
+                    return is_integer;
+                case 'c':
+                    return type != FormatArgType_String;
+                case 's':
+                    return type == FormatArgType_String;
+                default:
+                    return true;
+            }
+        }
+
+        /* Never defined: reaching a call while checking a format string makes it fail to compile, with the message in the diagnostic. */
+        void FormatStringError(const char *message);
+
+        template<typename... Args>
+        consteval void CheckFormatString(const char *str) {
+            constexpr FormatArgType Types[] = { GetFormatArgType<Args>()..., FormatArgType_Signed };
+
+            size_t num_fields = 0;
+            while (*str != '\0') {
+                if (str[0] == '{' && str[1] != '{') {
+                    FormatSpec spec;
+                    if (str = ParseFormatSpec(std::addressof(spec), str + 1); str == nullptr) {
+                        return FormatStringError("malformed replacement field");
+                    }
+                    if (num_fields == sizeof...(Args)) {
+                        return FormatStringError("more replacement fields than arguments");
+                    }
+                    if (!IsFormatSpecValidFor(spec, Types[num_fields])) {
+                        return FormatStringError("replacement field type does not match its argument");
+                    }
+                    ++num_fields;
+                } else if (str[0] == '}' && str[1] != '}') {
+                    return FormatStringError("unmatched '}' in format string");
+                } else {
+                    /* Escaped braces are two characters long. */
+                    str += (str[0] == '{' || str[0] == '}') ? 2 : 1;
+                }
+            }
+
+            if (num_fields != sizeof...(Args)) {
+                return FormatStringError("fewer replacement fields than arguments");
+            }
+        }
+
+        template<typename... Args>
+        class BasicFormatString {
+            private:
+                const char *m_str;
+            public:
+                template<size_t N>
+                consteval BasicFormatString(const char (&str)[N]) : m_str(str) {
+                    CheckFormatString<Args...>(m_str);
+                }
+
+                constexpr const char *Get() const { return m_str; }
+        };
+
+    }
+
+    /* A format string checked against its arguments' types at compile time. */
+    template<typename... Args>
+    using FormatString = impl::BasicFormatString<std::type_identity_t<Args>...>;
+
+}
@@ -0,0 +1,112 @@
+/*
+ * Copyright (c) Atmosphère-NX
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <stratosphere.hpp>
+#include "fatal_font_heap.hpp"
+
+namespace ams::fatal::srv::font {
+
+    void FontHeap::Initialize(void *memory, size_t memory_size) {
+        /* Trim the region to our alignment. */
+        const uintptr_t start = util::AlignUp(reinterpret_cast<uintptr_t>(memory), Alignment);
+        const uintptr_t end   = util::AlignDown(reinterpret_cast<uintptr_t>(memory) + memory_size, Alignment);
+        AMS_ABORT_UNLESS(start < end && end - start >= MinimumBlockSize);
+
+        m_start = reinterpret_cast<u8 *>(start);
+        m_end   = reinterpret_cast<u8 *>(end);
+
+        /* The whole region starts out as one free block. */
+        m_free_list       = reinterpret_cast<Block *>(m_start);
+        m_free_list->size = end - start;
+        m_free_list->next = nullptr;
+
+        m_statistics = {
+            .capacity  = end - start,
+            .alignment = Alignment,
+        };
+    }
+
+    void *FontHeap::Allocate(size_t size) {
+        const size_t block_size = HeaderSize + util::AlignUp(std::max<size_t>(size, 1), Alignment);
+
+        /* Find the first block that fits. */
+        for (Block **link = std::addressof(m_free_list); *link != nullptr; link = std::addressof((*link)->next)) {
+            Block *block = *link;
+            if (block->size < block_size) {
+                continue;
+            }
+
+            /* Split off the tail, if it's big enough to be useful. */
+            if (block->size - block_size >= MinimumBlockSize) {
+                Block *rest = reinterpret_cast<Block *>(reinterpret_cast<u8 *>(block) + block_size);
+                rest->size  = block->size - block_size;
+                rest->next  = block->next;
+                block->size = block_size;
+                *link       = rest;
+            } else {
+                *link = block->next;
+            }
+
+            m_statistics.used_size            += block->size;
+            m_statistics.peak_used_size        = std::max(m_statistics.peak_used_size, m_statistics.used_size);
+            m_statistics.num_allocations      += 1;
+            m_statistics.peak_num_allocations  = std::max(m_statistics.peak_num_allocations, m_statistics.num_allocations);
+
+            return reinterpret_cast<u8 *>(block) + HeaderSize;
+        }
+
+        ++m_statistics.failed_allocations;
+        return nullptr;
+    }
+
+    void FontHeap::Free(void *p) {
+        if (p == nullptr) {
+            return;
+        }
+
+        AMS_ABORT_UNLESS(this->Contains(p) && util::IsAligned(reinterpret_cast<uintptr_t>(p), Alignment));
+
+        Block *block = reinterpret_cast<Block *>(static_cast<u8 *>(p) - HeaderSize);
+        m_statistics.used_size       -= block->size;
+        m_statistics.num_allocations -= 1;
+
+        /* Find where the block goes in the address-ordered free list. */
+        Block *prev = nullptr;
+        Block *next = m_free_list;
+        while (next != nullptr && next < block) {
+            prev = next;
+            next = next->next;
+        }
+        AMS_ABORT_UNLESS(next != block);
+
+        /* Merge with the following block, if adjacent. */
+        block->next = next;
+        if (next != nullptr && reinterpret_cast<u8 *>(block) + block->size == reinterpret_cast<u8 *>(next)) {
+            block->size += next->size;
+            block->next  = next->next;
+        }
+
+        /* Merge with the preceding block, if adjacent. */
+        if (prev == nullptr) {
+            m_free_list = block;
+        } else if (reinterpret_cast<u8 *>(prev) + prev->size == reinterpret_cast<u8 *>(block)) {
+            prev->size += block->size;
+            prev->next  = block->next;
+        } else {
+            prev->next = block;
+        }
+    }
+
+}
@@ -0,0 +1,65 @@
+/*
+ * Copyright (c) Atmosphère-NX
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+#include <stratosphere.hpp>
+
+namespace ams::fatal::srv::font {
+
+    struct FontHeapStatistics {
+        size_t capacity;
+        size_t alignment;
+        size_t used_size;
+        size_t peak_used_size;
+        size_t num_allocations;
+        size_t peak_num_allocations;
+        u64 failed_allocations;
+    };
+
+    /* First-fit allocator over a fixed region, with address-ordered free list coalescing. */
+    class FontHeap {
+        NON_COPYABLE(FontHeap);
+        NON_MOVEABLE(FontHeap);
+        public:
+            static constexpr size_t Alignment = alignof(std::max_align_t);
+        private:
+            struct Block {
+                size_t size;
+                Block *next;
+            };
+            static_assert(sizeof(Block) <= Alignment);
+
+            static constexpr size_t HeaderSize = Alignment;
+            static constexpr size_t MinimumBlockSize = HeaderSize + Alignment;
+        private:
+            u8 *m_start;
+            u8 *m_end;
+            Block *m_free_list;
+            FontHeapStatistics m_statistics;
+        public:
+            constexpr FontHeap() : m_start(nullptr), m_end(nullptr), m_free_list(nullptr), m_statistics() { /* ... */ }
+
+            void Initialize(void *memory, size_t memory_size);
+
+            bool IsInitialized() const { return m_start != nullptr; }
+            bool Contains(const void *p) const { return m_start <= p && p < m_end; }
+
+            void *Allocate(size_t size);
+            void Free(void *p);
+
+            void GetStatistics(FontHeapStatistics *out) const { *out = m_statistics; }
+    };
+
+}
@@ -0,0 +1,46 @@
+/*
+ * Copyright (c) Atmosphère-NX
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+#include <stratosphere.hpp>
+#include "stb_truetype.h"
+
+namespace ams::fatal::srv::font {
+
+    /* Temporaries for stb_truetype and the rasterizers built on it. */
+    void *AllocateForRasterizer(size_t size, void *user_data);
+    void DeallocateForRasterizer(void *p, void *user_data);
+
+    namespace impl {
+
+        /* Changes whenever any rasterizer would produce different coverage for the same glyph, so that glyphs saved by an older one are not reused. */
+        constexpr u32 RasterizerAlgorithmRevision = 1;
+
+        /* stb_truetype's original scanline rasterizer, built from the shared implementation's internals. */
+        void MakeGlyphBitmapSubpixelV1(const stbtt_fontinfo *info, u8 *output, int out_w, int out_h, int out_stride, float scale_x, float scale_y, float shift_x, float shift_y, int glyph);
+
+        /* Receives one scanline's covered extent: count coverage values starting at x on row y, relative to the glyph's bitmap box. */
+        using CoverageSpanCallback = void (*)(void *arg, s32 x, s32 y, const u8 *coverage, s32 count);
+
+        /* stb_truetype's exact coverage rasterizer, handing each scanline to a callback as it is produced rather than storing it in a bitmap. */
+        void MakeGlyphSpansSubpixel(const stbtt_fontinfo *info, int out_w, int out_h, float scale_x, float scale_y, float shift_x, float shift_y, int glyph, CoverageSpanCallback callback, void *arg);
+
+        /* Exact coverage in integer arithmetic, with bounded working memory taken from the rasterizer temporaries: scale is 32.32 pixels per font unit, and shift_x 16.16 pixels. Fails if the glyph needs more memory than that. */
+        bool MakeGlyphBitmapFixedPoint(const stbtt_fontinfo *info, u8 *output, int out_w, int out_h, int out_stride, u64 scale, s32 shift_x, int off_x, int off_y, int glyph);
+        bool RasterizeGlyphShapeFixedPoint(u8 *output, int out_w, int out_h, int out_stride, const stbtt_vertex *vertices, int num_vertices, u64 scale, s32 shift_x, int off_x, int off_y, void *userdata);
+
+    }
+
+}
@@ -0,0 +1,277 @@
+/*
+ * Copyright (c) Atmosphère-NX
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <stratosphere.hpp>
+#include "fatal_font_rasterizer.hpp"
+
+namespace ams::fatal::srv::font::impl {
+
+    namespace {
+
+        /* Positions are 16.16 fixed point pixels, and coverage accumulates in the same units, FixedOne being a covered pixel. */
+        constexpr s32 FixedShift = 16;
+        constexpr s32 FixedOne   = 1 << FixedShift;
+
+        /* Curves are split until flat to within 0.35 pixels, as stbtt_Rasterize does; squared, so with twice the fractional bits. */
+        constexpr s64 FlatnessSquared = static_cast<s64>(0.35 * 0.35 * (static_cast<s64>(1) << (2 * FixedShift)));
+        constexpr s32 CurveDepthMax = 16;
+
+        /* Working memory is bounded, and taken from the rasterizer temporaries rather than kept for this rasterizer alone; glyphs that need more are left to the float rasterizer. */
+        constexpr size_t EdgeCountMax = 0x400;
+        constexpr s32 WidthMax = 0x200;
+
+        struct Edge {
+            s32 x0;
+            s32 y0;
+            s32 x1;
+            s32 y1;
+            s32 direction;
+        };
+
+        struct FixedPointRasterizer {
+            Edge edges[EdgeCountMax];
+            size_t num_edges;
+            bool overflowed;
+            s32 x;
+            s32 y;
+            s32 contour_x;
+            s32 contour_y;
+            s32 cells[WidthMax + 2];
+        };
+
+        void LineTo(FixedPointRasterizer *r, s32 x, s32 y) {
+            /* Edges run top to bottom; horizontal ones contribute nothing. */
+            if (y != r->y) {
+                if (r->num_edges == EdgeCountMax) {
+                    r->overflowed = true;
+                } else if (r->y < y) {
+                    r->edges[r->num_edges++] = { r->x, r->y, x, y, 1 };
+                } else {
+                    r->edges[r->num_edges++] = { x, y, r->x, r->y, -1 };
+                }
+            }
+
+            r->x = x;
+            r->y = y;
+        }
+
+        void MoveTo(FixedPointRasterizer *r, s32 x, s32 y) {
+            /* Every contour is closed, whether or not the outline says so. */
+            LineTo(r, r->contour_x, r->contour_y);
+
+            r->x = r->contour_x = x;
+            r->y = r->contour_y = y;
+        }
+
+        void QuadraticTo(FixedPointRasterizer *r, s64 x1, s64 y1, s64 x2, s64 y2, s32 depth) {
+            /* Past the depth limit, the rest of the curve is drawn as its chord, so that the outline still ends where the font says. */
+            if (depth > CurveDepthMax) {
+                LineTo(r, x2, y2);
+                return;
+            }
+
+            /* Split at the midpoint for as long as it strays too far from the chord, as stbtt__tesselate_curve does. */
+            const s64 x0 = r->x, y0 = r->y;
+            const s64 mx = (x0 + 2 * x1 + x2) / 4, my = (y0 + 2 * y1 + y2) / 4;
+            const s64 dx = (x0 + x2) / 2 - mx,     dy = (y0 + y2) / 2 - my;
+            if (dx * dx + dy * dy > FlatnessSquared) {
+                QuadraticTo(r, (x0 + x1) / 2, (y0 + y1) / 2, mx, my, depth + 1);
+                QuadraticTo(r, (x1 + x2) / 2, (y1 + y2) / 2, x2, y2, depth + 1);
+            } else {
+                LineTo(r, x2, y2);
+            }
+        }
+
+        u64 SquareRoot(u64 value) {
+            u64 result = 0;
+            for (u64 bit = static_cast<u64>(1) << 62; bit != 0; bit >>= 2) {
+                if (value >= result + bit) {
+                    value  -= result + bit;
+                    result  = (result >> 1) + bit;
+                } else {
+                    result >>= 1;
+                }
+            }
+            return result;
+        }
+
+        s64 GetLength(s64 dx, s64 dy) {
+            return SquareRoot(dx * dx + dy * dy);
+        }
+
+        void CubicTo(FixedPointRasterizer *r, s64 x1, s64 y1, s64 x2, s64 y2, s64 x3, s64 y3, s32 depth) {
+            if (depth > CurveDepthMax) {
+                LineTo(r, x3, y3);
+                return;
+            }
+
+            /* Flatness is how much longer the control polygon is than the chord, as stbtt__tesselate_cubic measures it. */
+            const s64 x0 = r->x, y0 = r->y;
+            const s64 long_length  = GetLength(x1 - x0, y1 - y0) + GetLength(x2 - x1, y2 - y1) + GetLength(x3 - x2, y3 - y2);
+            const s64 short_length = GetLength(x3 - x0, y3 - y0);
+            if (long_length * long_length - short_length * short_length > FlatnessSquared) {
+                const s64 x01 = (x0 + x1) / 2,   y01 = (y0 + y1) / 2;
+                const s64 x12 = (x1 + x2) / 2,   y12 = (y1 + y2) / 2;
+                const s64 x23 = (x2 + x3) / 2,   y23 = (y2 + y3) / 2;
+                const s64 xa  = (x01 + x12) / 2, ya  = (y01 + y12) / 2;
+                const s64 xb  = (x12 + x23) / 2, yb  = (y12 + y23) / 2;
+                const s64 mx  = (xa + xb) / 2,   my  = (ya + yb) / 2;
+
+                CubicTo(r, x01, y01, xa, ya, mx, my, depth + 1);
+                CubicTo(r, xb, yb, x23, y23, x3, y3, depth + 1);
+            } else {
+                LineTo(r, x3, y3);
+            }
+        }
+
+        s32 GetEdgeX(const Edge &edge, s32 y) {
+            return edge.x0 + static_cast<s64>(y - edge.y0) * (edge.x1 - edge.x0) / (edge.y1 - edge.y0);
+        }
+
+        void AccumulateSegment(s32 *cells, s32 x_top, s32 x_bottom, s32 height) {
+            /* Deposit the signed area to the right of a segment within one scanline, as the cells' running sum will see it. */
+            const s32 x0 = std::min(x_top, x_bottom), x1 = std::max(x_top, x_bottom);
+            const s32 x0i = x0 >> FixedShift, x1i = (x1 + FixedOne - 1) >> FixedShift;
+
+            if (x1i <= x0i + 1) {
+                /* Within a single pixel, the area splits at the segment's mean x. */
+                const s32 mean_x = ((x_top + x_bottom) >> 1) - (x0i << FixedShift);
+                const s32 right  = static_cast<s64>(height) * mean_x >> FixedShift;
+                cells[x0i]     += height - right;
+                cells[x0i + 1] += right;
+                return;
+            }
+
+            /* Across several, the first and last pixels hold triangles, and those between grow linearly. */
+            const s64 span  = x1 - x0;
+            const s64 x0f   = x0 - (static_cast<s64>(x0i) << FixedShift);
+            const s64 first = (FixedOne - x0f) * (FixedOne - x0f) / (2 * span);
+            const s64 x1f   = x1 - (static_cast<s64>(x1i - 1) << FixedShift);
+            const s64 last  = x1f * x1f / (2 * span);
+
+            s32 deposited = static_cast<s32>(height * first >> FixedShift);
+            cells[x0i] += deposited;
+
+            if (x1i > x0i + 2) {
+                const s64 step   = static_cast<s64>(FixedOne) * FixedOne / span;
+                const s64 second = (3 * FixedOne / 2 - x0f) * FixedOne / span;
+
+                const s32 second_area = static_cast<s32>(height * (second - first) >> FixedShift);
+                cells[x0i + 1] += second_area;
+                deposited      += second_area;
+
+                const s32 step_area = static_cast<s32>(height * step >> FixedShift);
+                for (s32 xi = x0i + 2; xi < x1i - 1; ++xi) {
+                    cells[xi] += step_area;
+                    deposited += step_area;
+                }
+            }
+
+            /* The last two pixels take whatever is left, so that rounding never leaves coverage behind the segment. */
+            const s32 last_area = static_cast<s32>(height * last >> FixedShift);
+            cells[x1i - 1] += height - deposited - last_area;
+            cells[x1i]     += last_area;
+        }
+
+        void RasterizeEdges(FixedPointRasterizer *r, u8 *output, s32 width, s32 height, s32 stride) {
+            /* Sort the edges by their top, so that each scanline can stop at the first one below it. */
+            std::sort(r->edges, r->edges + r->num_edges, [](const Edge &lhs, const Edge &rhs) { return lhs.y0 < rhs.y0; });
+
+            const s32 max_x = width << FixedShift;
+            for (s32 y = 0; y < height; ++y) {
+                const s32 top = y << FixedShift, bottom = top + FixedOne;
+                std::memset(r->cells, 0, (width + 2) * sizeof(r->cells[0]));
+
+                for (size_t i = 0; i < r->num_edges && r->edges[i].y0 < bottom; ++i) {
+                    const Edge &edge = r->edges[i];
+                    if (edge.y1 <= top) {
+                        continue;
+                    }
+
+                    const s32 y0 = std::max(edge.y0, top), y1 = std::min(edge.y1, bottom);
+                    const s32 x0 = std::clamp(GetEdgeX(edge, y0), 0, max_x), x1 = std::clamp(GetEdgeX(edge, y1), 0, max_x);
+                    AccumulateSegment(r->cells, x0, x1, (y1 - y0) * edge.direction);
+                }
+
+                /* The running sum is the signed area covered; overlapping contours saturate, as in stb_truetype. */
+                s32 sum = 0;
+                for (s32 x = 0; x < width; ++x) {
+                    sum += r->cells[x];
+                    output[y * stride + x] = static_cast<u8>((std::min(std::abs(sum), FixedOne) * 255 + FixedOne / 2) >> FixedShift);
+                }
+            }
+        }
+
+    }
+
+    bool RasterizeGlyphShapeFixedPoint(u8 *output, int out_w, int out_h, int out_stride, const stbtt_vertex *vertices, int num_vertices, u64 scale, s32 shift_x, int off_x, int off_y, void *userdata) {
+        if (out_w > WidthMax) {
+            return false;
+        }
+
+        FixedPointRasterizer *r = static_cast<FixedPointRasterizer *>(AllocateForRasterizer(sizeof(FixedPointRasterizer), userdata));
+        if (r == nullptr) {
+            return false;
+        }
+        ON_SCOPE_EXIT { DeallocateForRasterizer(r, userdata); };
+
+        /* Glyph space is y-up, and the bitmap's origin is at its box's top left. */
+        const auto to_x = [&](s32 x) -> s64 { return (x * static_cast<s64>(scale) >> FixedShift) + shift_x - (static_cast<s64>(off_x) << FixedShift); };
+        const auto to_y = [&](s32 y) -> s64 { return -(y * static_cast<s64>(scale) >> FixedShift) - (static_cast<s64>(off_y) << FixedShift); };
+
+        r->num_edges  = 0;
+        r->overflowed = false;
+        r->x = r->y = r->contour_x = r->contour_y = 0;
+
+        for (int i = 0; i < num_vertices; ++i) {
+            const stbtt_vertex &v = vertices[i];
+            switch (v.type) {
+                case STBTT_vmove:
+                    MoveTo(r, to_x(v.x), to_y(v.y));
+                    break;
+                case STBTT_vline:
+                    LineTo(r, to_x(v.x), to_y(v.y));
+                    break;
+                case STBTT_vcurve:
+                    QuadraticTo(r, to_x(v.cx), to_y(v.cy), to_x(v.x), to_y(v.y), 0);
+                    break;
+                case STBTT_vcubic:
+                    CubicTo(r, to_x(v.cx), to_y(v.cy), to_x(v.cx1), to_y(v.cy1), to_x(v.x), to_y(v.y), 0);
+                    break;
+            }
+        }
+        LineTo(r, r->contour_x, r->contour_y);
+
+        if (r->overflowed) {
+            return false;
+        }
+
+        RasterizeEdges(r, output, out_w, out_h, out_stride);
+        return true;
+    }
+
+    bool MakeGlyphBitmapFixedPoint(const stbtt_fontinfo *info, u8 *output, int out_w, int out_h, int out_stride, u64 scale, s32 shift_x, int off_x, int off_y, int glyph) {
+        if (out_w > WidthMax) {
+            return false;
+        }
+
+        stbtt_vertex *vertices;
+        const int num_vertices = stbtt_GetGlyphShape(info, glyph, std::addressof(vertices));
+        ON_SCOPE_EXIT { stbtt_FreeShape(info, vertices); };
+
+        return RasterizeGlyphShapeFixedPoint(output, out_w, out_h, out_stride, vertices, num_vertices, scale, shift_x, off_x, off_y, info->userdata);
+    }
+
+}
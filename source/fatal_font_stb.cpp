@@ -0,0 +1,386 @@
+/*
+ * Copyright (c) Atmosphère-NX
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <stratosphere.hpp>
+#include "fatal_font_rasterizer.hpp"
+
+/* The one copy of stb_truetype that everything shares. The span and version 1 rasterizers live here too, as they are built from the library's internals. */
+#define STBTT_assert(x)    AMS_ASSERT(x)
+#define STBTT_malloc(x,u)  ams::fatal::srv::font::AllocateForRasterizer(x,u)
+#define STBTT_free(x,u)    ams::fatal::srv::font::DeallocateForRasterizer(x,u)
+
+#define STBTT_RASTERIZER_VERSION 2
+#define STB_TRUETYPE_IMPLEMENTATION
+#include "stb_truetype.h"
+#undef  STBTT_RASTERIZER_VERSION
+#undef  STB_TRUETYPE_IMPLEMENTATION
+
+#undef  STBTT_malloc
+#undef  STBTT_free
+#undef  STBTT_assert
+
+namespace ams::fatal::srv::font::impl {
+
+    namespace {
+
+        /* Builds the edge list as stbtt__rasterize does, in units of vsubsample scanlines per pixel, sorted by their highest point, with a sentinel at the end. */
+        stbtt__edge *BuildSortedEdges(int *out_num_edges, const stbtt__point *pts, const int *wcount, int windings, float scale_x, float scale_y, float shift_x, float shift_y, int vsubsample, void *userdata) {
+            int num_edges = 0;
+            for (int i = 0; i < windings; ++i) {
+                num_edges += wcount[i];
+            }
+
+            stbtt__edge *edges = static_cast<stbtt__edge *>(AllocateForRasterizer(sizeof(*edges) * (num_edges + 1), userdata));
+            if (edges == nullptr) {
+                return nullptr;
+            }
+
+            /* Glyph space is y-up, so every edge is flipped; horizontal edges contribute nothing. */
+            num_edges = 0;
+            for (int i = 0, m = 0; i < windings; m += wcount[i++]) {
+                const stbtt__point *p = pts + m;
+                for (int k = 0, j = wcount[i] - 1; k < wcount[i]; j = k++) {
+                    if (p[j].y == p[k].y) {
+                        continue;
+                    }
+
+                    const bool invert = p[j].y > p[k].y;
+                    const int a = invert ? j : k, b = invert ? k : j;
+                    edges[num_edges++] = {
+                        .x0     = p[a].x * scale_x + shift_x,
+                        .y0     = (p[a].y * -scale_y + shift_y) * vsubsample,
+                        .x1     = p[b].x * scale_x + shift_x,
+                        .y1     = (p[b].y * -scale_y + shift_y) * vsubsample,
+                        .invert = invert,
+                    };
+                }
+            }
+
+            stbtt__sort_edges(edges, num_edges);
+
+            *out_num_edges = num_edges;
+            return edges;
+        }
+
+        /* stbtt__rasterize_sorted_edges, converting each scanline's coverage into one row buffer, and passing on the part of it that is covered. */
+        void RasterizeSortedEdgesToSpans(stbtt__edge *e, int n, int width, int height, int off_x, int off_y, CoverageSpanCallback callback, void *arg, void *userdata) {
+            /* One allocation holds the area and cover accumulators, and the row they resolve into. */
+            float *scanline = static_cast<float *>(AllocateForRasterizer((width * 2 + 1) * sizeof(float) + width, userdata));
+            if (scanline == nullptr) {
+                return;
+            }
+            ON_SCOPE_EXIT { DeallocateForRasterizer(scanline, userdata); };
+
+            float *scanline2 = scanline + width;
+            u8 *row = reinterpret_cast<u8 *>(scanline2 + width + 1);
+
+            stbtt__hheap hh = { 0, 0, 0 };
+            ON_SCOPE_EXIT { stbtt__hheap_cleanup(std::addressof(hh), userdata); };
+
+            stbtt__active_edge *active = nullptr;
+            e[n].y0 = static_cast<float>(off_y + height) + 1;
+
+            for (int j = 0; j < height; ++j) {
+                const float scan_y_top    = off_y + j + 0.0f;
+                const float scan_y_bottom = off_y + j + 1.0f;
+
+                std::memset(scanline,  0, width * sizeof(float));
+                std::memset(scanline2, 0, (width + 1) * sizeof(float));
+
+                /* Retire the edges that end above this scanline. */
+                for (stbtt__active_edge **step = std::addressof(active); *step != nullptr; /* ... */) {
+                    stbtt__active_edge *z = *step;
+                    if (z->ey <= scan_y_top) {
+                        *step = z->next;
+                        AMS_ASSERT(z->direction);
+                        z->direction = 0;
+                        stbtt__hheap_free(std::addressof(hh), z);
+                    } else {
+                        step = std::addressof(z->next);
+                    }
+                }
+
+                /* Activate the edges that start above its bottom. */
+                for (/* ... */; e->y0 <= scan_y_bottom; ++e) {
+                    if (e->y0 == e->y1) {
+                        continue;
+                    }
+
+                    if (stbtt__active_edge *z = stbtt__new_active(std::addressof(hh), e, off_x, scan_y_top, userdata); z != nullptr) {
+                        /* Subpixel positioning can leave an edge a hair above the first scanline. */
+                        if (j == 0 && off_y != 0 && z->ey < scan_y_top) {
+                            z->ey = scan_y_top;
+                        }
+                        AMS_ASSERT(z->ey >= scan_y_top);
+
+                        z->next = active;
+                        active  = z;
+                    }
+                }
+
+                if (active != nullptr) {
+                    stbtt__fill_active_edges_new(scanline, scanline2 + 1, width, active, scan_y_top);
+                }
+
+                float sum = 0.0f;
+                for (int i = 0; i < width; ++i) {
+                    sum += scanline2[i];
+                    row[i] = static_cast<u8>(std::min(static_cast<int>(std::fabs(scanline[i] + sum) * 255 + 0.5f), 255));
+                }
+
+                /* Only pass on the extent with any coverage. */
+                int first = 0, last = width;
+                while (first < last && row[first] == 0) {
+                    ++first;
+                }
+                while (last > first && row[last - 1] == 0) {
+                    --last;
+                }
+                if (first < last) {
+                    callback(arg, first, j, row + first, last - first);
+                }
+
+                for (stbtt__active_edge *z = active; z != nullptr; z = z->next) {
+                    z->fx += z->fdx;
+                }
+            }
+        }
+
+        /* The version 1 rasterizer's active edge, which steps along in fixed point; stb_truetype's own stbtt__active_edge is laid out for version 2. */
+        struct ActiveEdgeV1 {
+            ActiveEdgeV1 *next;
+            int x;
+            int dx;
+            float ey;
+            int direction;
+        };
+
+        constexpr int V1FixShift = 10;
+        constexpr int V1Fix      = 1 << V1FixShift;
+        constexpr int V1FixMask  = V1Fix - 1;
+
+        /* Flattened outlines are rasterized with several scanlines per pixel, and more of them for short glyphs. */
+        constexpr int GetVerticalSubsampleV1(int height) {
+            return height < 8 ? 15 : 5;
+        }
+
+        ActiveEdgeV1 *NewActiveEdgeV1(stbtt__hheap *hh, const stbtt__edge *e, int off_x, float start_point, void *userdata) {
+            ActiveEdgeV1 *z = static_cast<ActiveEdgeV1 *>(stbtt__hheap_alloc(hh, sizeof(*z), userdata));
+            AMS_ASSERT(z != nullptr);
+            if (z == nullptr) {
+                return z;
+            }
+
+            /* Round the step down, so that it never overshoots. */
+            const float dxdy = (e->x1 - e->x0) / (e->y1 - e->y0);
+            z->dx = dxdy < 0 ? -static_cast<int>(std::floor(V1Fix * -dxdy)) : static_cast<int>(std::floor(V1Fix * dxdy));
+
+            z->x  = static_cast<int>(std::floor(V1Fix * e->x0 + z->dx * (start_point - e->y0)));
+            z->x -= off_x * V1Fix;
+
+            z->ey        = e->y1;
+            z->next      = nullptr;
+            z->direction = e->invert ? 1 : -1;
+            return z;
+        }
+
+        /* stbtt__fill_active_edges: adds one scanline's non-zero winding coverage to the row, clipping fills that extend past either end. */
+        void FillActiveEdgesV1(u8 *scanline, int len, const ActiveEdgeV1 *e, int max_weight) {
+            int x0 = 0, w = 0;
+            for (/* ... */; e != nullptr; e = e->next) {
+                if (w == 0) {
+                    x0 = e->x;
+                    w += e->direction;
+                    continue;
+                }
+
+                const int x1 = e->x;
+                w += e->direction;
+                if (w != 0) {
+                    continue;
+                }
+
+                /* The winding went back to zero, so everything from x0 to x1 is inside. */
+                int i = x0 >> V1FixShift;
+                int j = x1 >> V1FixShift;
+                if (i < len && j >= 0) {
+                    if (i == j) {
+                        scanline[i] = scanline[i] + static_cast<u8>((x1 - x0) * max_weight >> V1FixShift);
+                    } else {
+                        if (i >= 0) {
+                            scanline[i] = scanline[i] + static_cast<u8>(((V1Fix - (x0 & V1FixMask)) * max_weight) >> V1FixShift);
+                        } else {
+                            i = -1;
+                        }
+
+                        if (j < len) {
+                            scanline[j] = scanline[j] + static_cast<u8>(((x1 & V1FixMask) * max_weight) >> V1FixShift);
+                        } else {
+                            j = len;
+                        }
+
+                        for (++i; i < j; ++i) {
+                            scanline[i] = scanline[i] + static_cast<u8>(max_weight);
+                        }
+                    }
+                }
+            }
+        }
+
+        /* stbtt__rasterize_sorted_edges for version 1, accumulating each pixel's subsampled scanlines directly into its output row. */
+        void RasterizeSortedEdgesV1(u8 *output, int width, int height, int stride, stbtt__edge *e, int n, int vsubsample, int off_x, int off_y, void *userdata) {
+            stbtt__hheap hh = { 0, 0, 0 };
+            ON_SCOPE_EXIT { stbtt__hheap_cleanup(std::addressof(hh), userdata); };
+
+            ActiveEdgeV1 *active = nullptr;
+            const int max_weight = 255 / vsubsample;
+
+            int y = off_y * vsubsample;
+            e[n].y0 = (off_y + height) * static_cast<float>(vsubsample) + 1;
+
+            for (int j = 0; j < height; ++j) {
+                u8 *scanline = output + j * stride;
+                std::memset(scanline, 0, width);
+
+                for (int s = 0; s < vsubsample; ++s, ++y) {
+                    /* Sample at the center of the scanline. */
+                    const float scan_y = y + 0.5f;
+
+                    /* Retire the edges that end above it, and step the rest down to it. */
+                    for (ActiveEdgeV1 **step = std::addressof(active); *step != nullptr; /* ... */) {
+                        ActiveEdgeV1 *z = *step;
+                        if (z->ey <= scan_y) {
+                            *step = z->next;
+                            AMS_ASSERT(z->direction);
+                            z->direction = 0;
+                            stbtt__hheap_free(std::addressof(hh), z);
+                        } else {
+                            z->x += z->dx;
+                            step = std::addressof(z->next);
+                        }
+                    }
+
+                    /* Keep the list sorted by x, as the edges may have crossed. */
+                    for (bool changed = true; changed; /* ... */) {
+                        changed = false;
+                        for (ActiveEdgeV1 **step = std::addressof(active); *step != nullptr && (*step)->next != nullptr; step = std::addressof((*step)->next)) {
+                            if ((*step)->x > (*step)->next->x) {
+                                ActiveEdgeV1 *t = *step;
+                                ActiveEdgeV1 *q = t->next;
+                                t->next = q->next;
+                                q->next = t;
+                                *step   = q;
+                                changed = true;
+                            }
+                        }
+                    }
+
+                    /* Insert, in order, the edges that start above the scanline and end below it. */
+                    for (/* ... */; e->y0 <= scan_y; ++e) {
+                        if (e->y1 <= scan_y) {
+                            continue;
+                        }
+
+                        if (ActiveEdgeV1 *z = NewActiveEdgeV1(std::addressof(hh), e, off_x, scan_y, userdata); z != nullptr) {
+                            if (active == nullptr) {
+                                active = z;
+                            } else if (z->x < active->x) {
+                                z->next = active;
+                                active  = z;
+                            } else {
+                                ActiveEdgeV1 *p = active;
+                                while (p->next != nullptr && p->next->x < z->x) {
+                                    p = p->next;
+                                }
+                                z->next = p->next;
+                                p->next = z;
+                            }
+                        }
+                    }
+
+                    if (active != nullptr) {
+                        FillActiveEdgesV1(scanline, width, active, max_weight);
+                    }
+                }
+            }
+        }
+
+    }
+
+    void MakeGlyphSpansSubpixel(const stbtt_fontinfo *info, int out_w, int out_h, float scale_x, float scale_y, float shift_x, float shift_y, int glyph, CoverageSpanCallback callback, void *arg) {
+        if (out_w <= 0 || out_h <= 0) {
+            return;
+        }
+
+        stbtt_vertex *vertices;
+        const int num_verts = stbtt_GetGlyphShape(info, glyph, std::addressof(vertices));
+        ON_SCOPE_EXIT { DeallocateForRasterizer(vertices, info->userdata); };
+
+        int ix0, iy0;
+        stbtt_GetGlyphBitmapBoxSubpixel(info, glyph, scale_x, scale_y, shift_x, shift_y, std::addressof(ix0), std::addressof(iy0), nullptr, nullptr);
+
+        /* Flatten to the same tolerance as stbtt_Rasterize, so that the spans match stb_truetype's bitmaps exactly. */
+        const float scale = std::min(scale_x, scale_y);
+        int *winding_lengths = nullptr, winding_count = 0;
+        stbtt__point *windings = stbtt_FlattenCurves(vertices, num_verts, 0.35f / scale, std::addressof(winding_lengths), std::addressof(winding_count), info->userdata);
+        if (windings == nullptr) {
+            return;
+        }
+        ON_SCOPE_EXIT { DeallocateForRasterizer(winding_lengths, info->userdata); DeallocateForRasterizer(windings, info->userdata); };
+
+        int num_edges;
+        stbtt__edge *edges = BuildSortedEdges(std::addressof(num_edges), windings, winding_lengths, winding_count, scale_x, scale_y, shift_x, shift_y, 1, info->userdata);
+        if (edges == nullptr) {
+            return;
+        }
+        ON_SCOPE_EXIT { DeallocateForRasterizer(edges, info->userdata); };
+
+        RasterizeSortedEdgesToSpans(edges, num_edges, out_w, out_h, ix0, iy0, callback, arg, info->userdata);
+    }
+
+    void MakeGlyphBitmapSubpixelV1(const stbtt_fontinfo *info, u8 *output, int out_w, int out_h, int out_stride, float scale_x, float scale_y, float shift_x, float shift_y, int glyph) {
+        /* As stbtt_MakeGlyphBitmapSubpixel, but rasterized by the version 1 rasterizer above. */
+        if (out_w == 0 || out_h == 0) {
+            return;
+        }
+
+        stbtt_vertex *vertices;
+        const int num_verts = stbtt_GetGlyphShape(info, glyph, std::addressof(vertices));
+        ON_SCOPE_EXIT { stbtt_FreeShape(info, vertices); };
+
+        int ix0, iy0;
+        stbtt_GetGlyphBitmapBoxSubpixel(info, glyph, scale_x, scale_y, shift_x, shift_y, std::addressof(ix0), std::addressof(iy0), nullptr, nullptr);
+
+        /* Flattened to the same tolerance as stbtt_Rasterize. */
+        const float scale = std::min(scale_x, scale_y);
+        int *winding_lengths = nullptr, winding_count = 0;
+        stbtt__point *windings = stbtt_FlattenCurves(vertices, num_verts, 0.35f / scale, std::addressof(winding_lengths), std::addressof(winding_count), info->userdata);
+        if (windings == nullptr) {
+            return;
+        }
+        ON_SCOPE_EXIT { DeallocateForRasterizer(winding_lengths, info->userdata); DeallocateForRasterizer(windings, info->userdata); };
+
+        const int vsubsample = GetVerticalSubsampleV1(out_h);
+        int num_edges;
+        stbtt__edge *edges = BuildSortedEdges(std::addressof(num_edges), windings, winding_lengths, winding_count, scale_x, scale_y, shift_x, shift_y, vsubsample, info->userdata);
+        if (edges == nullptr) {
+            return;
+        }
+        ON_SCOPE_EXIT { DeallocateForRasterizer(edges, info->userdata); };
+
+        RasterizeSortedEdgesV1(output, out_w, out_h, out_stride, edges, num_edges, vsubsample, ix0, iy0, info->userdata);
+    }
+
+}
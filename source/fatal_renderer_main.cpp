@@ -16,6 +16,7 @@
 #include <stratosphere.hpp>
 #include "fatal_screen.hpp"
 #include "fatal_font.hpp"
+#include "fatal_benchmark.hpp"
 
 namespace ams {
 
@@ -29,6 +30,11 @@ namespace ams {
         constexpr u32 FatalScreenWidthAlignedBytes = util::AlignUp(FatalScreenWidth * FatalScreenBpp, 64);
         constexpr u32 FatalScreenWidthAligned = FatalScreenWidthAlignedBytes / FatalScreenBpp;
 
+        /* Font heap, sized from the peak usage reported below. */
+        constexpr size_t FontHeapSize = 1_MB;
+
+        alignas(os::MemoryPageSize) constinit u8 g_font_heap_memory[FontHeapSize];
+
         Result SaveData(const char *fn, const void *data, size_t size) {
             fs::CreateFile(fn, size);
 
@@ -41,6 +47,12 @@ namespace ams {
             R_RETURN(fs::WriteFile(file, 0, data, size, fs::WriteOption::Flush));
         }
 
+        void PrintFontHeapStatistics() {
+            fatal::srv::font::FontHeapStatistics font_heap_stats;
+            fatal::srv::font::GetHeapStatistics(std::addressof(font_heap_stats));
+            printf("Font heap: %zu/%zu bytes used (peak %zu), %zu allocations (peak %zu), %" PRIu64 " failed, %zu-byte alignment\n", font_heap_stats.used_size, font_heap_stats.capacity, font_heap_stats.peak_used_size, font_heap_stats.num_allocations, font_heap_stats.peak_num_allocations, font_heap_stats.failed_allocations, font_heap_stats.alignment);
+        }
+
     }
 
     void Main() {
@@ -50,18 +62,53 @@ namespace ams {
         const auto argc = os::GetHostArgc();
         const auto argv = os::GetHostArgv();
 
-        if (argc != 1) {
-            printf("Usage: %s", argv[0]);
-            return;
+        bool benchmark = false;
+        const char *glyph_cache_file = nullptr;
+        for (int i = 1; i < argc; ++i) {
+            if (std::strcmp(argv[i], "benchmark") == 0) {
+                benchmark = true;
+            } else if (std::strcmp(argv[i], "--glyph-cache") == 0 && i + 1 < argc) {
+                glyph_cache_file = argv[++i];
+            } else {
+                printf("Usage: %s [benchmark] [--glyph-cache <file>]", argv[0]);
+                return;
+            }
         }
 
         printf("Setting up font\n");
 
+        fatal::srv::font::SetHeapMemory(g_font_heap_memory, sizeof(g_font_heap_memory));
+
+        if (glyph_cache_file != nullptr) {
+            const char *path = nullptr;
+            AMS_ABORT_UNLESS(fatal::srv::font::CreateFilePath(std::addressof(path), glyph_cache_file));
+            ON_SCOPE_EXIT { std::free(const_cast<char *>(path)); };
+
+            fatal::srv::font::SetGlyphCacheFilePath(path);
+        }
+
         if (const Result res = fatal::srv::font::InitializeSharedFont(); R_FAILED(res)) {
             fprintf(stderr, "Failed to initialize shared font: 2%03d-%04d\n", res.GetModule(), res.GetDescription());
             return;
         }
 
+        printf("Blend kernel: %s\n", fatal::srv::font::GetBlendKernelName(fatal::srv::font::GetBlendKernel()));
+
+        fatal::srv::font::GlyphAtlasStatistics glyph_atlas_stats;
+        fatal::srv::font::GetGlyphAtlasStatistics(std::addressof(glyph_atlas_stats));
+        printf("Glyph atlas (%s): %ux%u, %zu glyphs, %zu bytes (%zu bytes of coverage runs), built in %" PRId64 " us\n", glyph_atlas_stats.is_compiled ? "compiled" : (glyph_atlas_stats.is_cached ? "cached" : "packed"), glyph_atlas_stats.width, glyph_atlas_stats.height, glyph_atlas_stats.num_glyphs, glyph_atlas_stats.memory_size, glyph_atlas_stats.coverage_runs_size, glyph_atlas_stats.build_time_us);
+
+        if (benchmark) {
+            const size_t num_failed_checks = fatal::srv::RunBenchmarks();
+            PrintFontHeapStatistics();
+
+            if (num_failed_checks != 0) {
+                fprintf(stderr, "%zu benchmark checks failed\n", num_failed_checks);
+                AMS_ABORT("Benchmark checks failed");
+            }
+            return;
+        }
+
         printf("Making paths\n");
         const char *path64 = nullptr;
         const char *path32 = nullptr;
@@ -75,6 +122,26 @@ namespace ams {
         SaveData(path32, fatal::srv::RenderFatal(true), FatalScreenWidthAlignedBytes * FatalScreenHeight);
         printf("Saved aarch32 to aarch32.bin\n");
 
+        fatal::srv::font::GlyphCacheStatistics glyph_cache_stats;
+        fatal::srv::font::GetGlyphCacheStatistics(std::addressof(glyph_cache_stats));
+        printf("Glyph cache: %" PRIu64 " hits, %" PRIu64 " misses, %" PRIu64 " evictions (%zu glyphs, %zu bytes)\n", glyph_cache_stats.hits, glyph_cache_stats.misses, glyph_cache_stats.evictions, glyph_cache_stats.num_entries, glyph_cache_stats.bitmap_size);
+
+        if (glyph_cache_file != nullptr) {
+            printf("Glyph cache file: %" PRIu64 " hits (%zu glyphs, %zu bytes)\n", glyph_cache_stats.file_hits, glyph_cache_stats.file_num_glyphs, glyph_cache_stats.file_size);
+
+            if (const Result res = fatal::srv::font::SaveGlyphCacheFile(); R_FAILED(res)) {
+                fprintf(stderr, "Failed to save glyph cache file: 2%03d-%04d\n", res.GetModule(), res.GetDescription());
+            } else {
+                printf("Saved glyph cache to %s\n", glyph_cache_file);
+            }
+        }
+
+        fatal::srv::font::FontFaceStatistics font_face_stats;
+        fatal::srv::font::GetFontFaceStatistics(std::addressof(font_face_stats));
+        printf("Font faces: %zu loaded, %zu codepoint pages (%zu bytes; %zu codepoints from fallback faces, %zu missing), %" PRIu64 " cmap searches\n", font_face_stats.num_faces, font_face_stats.num_pages, font_face_stats.page_table_size, font_face_stats.num_fallback, font_face_stats.num_missing, font_face_stats.cmap_searches);
+
+        PrintFontHeapStatistics();
+
         printf("Done!\n");
     }
 
@@ -322,7 +322,7 @@ namespace ams::fatal::srv {
         u16 *frame_buffer = static_cast<u16 *>(buffer);
 
         /* Let the font manager know about our framebuffer. */
-        font::ConfigureFontFramebuffer(frame_buffer, GetPixelOffset);
+        font::ConfigureFontFramebuffer(frame_buffer, FatalScreenWidth, FatalScreenHeight, GetPixelOffset);
         font::SetFontColor(0xFFFF);
 
         /* Draw a background. */
@@ -342,12 +342,12 @@ namespace ams::fatal::srv {
         /* Draw error message and firmware. */
         font::SetPosition(start_x, start_y);
         font::SetFontSize(16.0f);
-        font::PrintFormat((const char *)u8"Error Code: 2%03d-%04d (0x%x)\n", 2, 2, 0x202);
+        font::Format("Error Code: 2{:03}-{:04} (0x{:x})\n", 2, 2, 0x202);
         font::AddSpacingLines(0.5f);
-        font::PrintFormatLine(  "Program:  %016llX", 0xCCCCCCCCCCCCCCCCull);
+        font::FormatLine("Program:  {:016X}", 0xCCCCCCCCCCCCCCCCull);
         font::AddSpacingLines(0.5f);
 
-        font::PrintFormatLine((const char *)u8"Firmware: %s (Atmosphere %u.%u.%u-%s)", "16.0.0", ATMOSPHERE_RELEASE_VERSION, ams::GetGitRevision());
+        font::FormatLine("Firmware: {} (Atmosphere {}.{}.{}-{})", "16.0.0", ATMOSPHERE_RELEASE_VERSION, ams::GetGitRevision());
         font::AddSpacingLines(1.5f);
         font::Print((const char *)u8"An error has occured.\n\n"
                                  u8"Please press the POWER Button to restart the console normally, or a VOL button\n"
@@ -376,7 +376,7 @@ namespace ams::fatal::srv {
         if (is_aarch32) {
             for (size_t i = 0; i < (aarch32::RegisterName_GeneralPurposeCount / 2); i++) {
                 u32 x = font::GetX();
-                font::PrintFormat("%s:", aarch32::CpuContext::RegisterNameStrings[i]);
+                font::Format("{}:", aarch32::CpuContext::RegisterNameStrings[i]);
                 font::SetPosition(x + 47, font::GetY());
                 if (true) {
                     font::PrintMonospaceU32(i * 0x01010101u);
@@ -386,7 +386,7 @@ namespace ams::fatal::srv {
                 }
                 font::Print("  ");
                 pc_x = font::GetX();
-                font::PrintFormat("%s:", aarch32::CpuContext::RegisterNameStrings[i + (aarch32::RegisterName_GeneralPurposeCount / 2)]);
+                font::Format("{}:", aarch32::CpuContext::RegisterNameStrings[i + (aarch32::RegisterName_GeneralPurposeCount / 2)]);
                 font::SetPosition(pc_x + 47, font::GetY());
                 if (true) {
                     font::PrintMonospaceU32((i + (aarch32::RegisterName_GeneralPurposeCount / 2)) * 0x01010101u);
@@ -406,7 +406,7 @@ namespace ams::fatal::srv {
         } else {
             for (size_t i = 0; i < aarch64::RegisterName_GeneralPurposeCount / 2; i++) {
                 u32 x = font::GetX();
-                font::PrintFormat("%s:", aarch64::CpuContext::RegisterNameStrings[i]);
+                font::Format("{}:", aarch64::CpuContext::RegisterNameStrings[i]);
                 font::SetPosition(x + 47, font::GetY());
                 if (true) {
                     font::PrintMonospaceU64(i * 0x0101010101010101ull);
@@ -415,7 +415,7 @@ namespace ams::fatal::srv {
                 }
                 font::Print("  ");
                 pc_x = font::GetX();
-                font::PrintFormat("%s:", aarch64::CpuContext::RegisterNameStrings[i + (aarch64::RegisterName_GeneralPurposeCount / 2)]);
+                font::Format("{}:", aarch64::CpuContext::RegisterNameStrings[i + (aarch64::RegisterName_GeneralPurposeCount / 2)]);
                 font::SetPosition(pc_x + 47, font::GetY());
                 if (true) {
                     font::PrintMonospaceU64((i + (aarch64::RegisterName_GeneralPurposeCount / 2)) * 0x0101010101010101ull);
@@ -449,6 +449,10 @@ namespace ams::fatal::srv {
         /* Print Backtrace. */
         u32 bt_size = is_aarch32 ? aarch32::CpuContext::MaxStackTraceDepth : aarch64::CpuContext::MaxStackTraceDepth;
 
+        /* Keep the backtrace within its column, even with long addresses. */
+        font::PushClipRect(backtrace_x, 0, FatalScreenWidth - start_x - backtrace_x, FatalScreenHeight);
+        ON_SCOPE_EXIT { font::PopClipRect(); };
+
         font::SetPosition(backtrace_x, backtrace_y);
         if (bt_size == 0) {
             if (is_aarch32) {
@@ -477,7 +481,7 @@ namespace ams::fatal::srv {
 
                     if (i < bt_size) {
                         u32 x = font::GetX();
-                        font::PrintFormat("BT[%02d]: ", i);
+                        font::Format("BT[{:02}]: ", i);
                         font::SetPosition(x + 72, font::GetY());
                         font::PrintMonospaceU32(bt_cur);
                         font::PrintMonospaceBlank(8);
@@ -486,7 +490,7 @@ namespace ams::fatal::srv {
 
                     if (i + aarch32::CpuContext::MaxStackTraceDepth / 2 < bt_size) {
                         u32 x = font::GetX();
-                        font::PrintFormat("BT[%02d]: ", i + aarch32::CpuContext::MaxStackTraceDepth / 2);
+                        font::Format("BT[{:02}]: ", i + aarch32::CpuContext::MaxStackTraceDepth / 2);
                         font::SetPosition(x + 72, font::GetY());
                         font::PrintMonospaceU32(bt_next);
                         font::PrintMonospaceBlank(8);
@@ -511,7 +515,7 @@ namespace ams::fatal::srv {
 
                     if (i < bt_size) {
                         u32 x = font::GetX();
-                        font::PrintFormat("BT[%02d]: ", i);
+                        font::Format("BT[{:02}]: ", i);
                         font::SetPosition(x + 72, font::GetY());
                         font::PrintMonospaceU64(bt_cur);
                         font::Print("  ");
@@ -519,7 +523,7 @@ namespace ams::fatal::srv {
 
                     if (i + aarch64::CpuContext::MaxStackTraceDepth / 2 < bt_size) {
                         u32 x = font::GetX();
-                        font::PrintFormat("BT[%02d]: ", i + aarch64::CpuContext::MaxStackTraceDepth / 2);
+                        font::Format("BT[{:02}]: ", i + aarch64::CpuContext::MaxStackTraceDepth / 2);
                         font::SetPosition(x + 72, font::GetY());
                         font::PrintMonospaceU64(bt_next);
                     }
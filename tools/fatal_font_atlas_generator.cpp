@@ -0,0 +1,201 @@
+/*
+ * Copyright (c) Atmosphère-NX
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Host tool which bakes the fatal screen's glyphs into fatal_font_atlas.inc, so that fatal never needs to rasterize them. */
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#define STBTT_STATIC
+#define STB_TRUETYPE_IMPLEMENTATION
+#include "../source/stb_truetype.h"
+
+namespace {
+
+    /* These must match the font sizes and scale computation used by fatal_font.cpp. */
+    constexpr float FontSizes[] = { 16.0f, 14.0f };
+    constexpr size_t FontSizeCount = sizeof(FontSizes) / sizeof(FontSizes[0]);
+    constexpr int FirstCodePoint = 0x20;
+    constexpr int CodePointCount = 0x7F - FirstCodePoint;
+    constexpr int AtlasWidth = 256;
+    constexpr int AtlasMaxHeight = 1024;
+
+    constexpr const char LicenseHeader[] =
+        "/*\n"
+        " * Copyright (c) Atmosphère-NX\n"
+        " *\n"
+        " * This program is free software; you can redistribute it and/or modify it\n"
+        " * under the terms and conditions of the GNU General Public License,\n"
+        " * version 2, as published by the Free Software Foundation.\n"
+        " *\n"
+        " * This program is distributed in the hope it will be useful, but WITHOUT\n"
+        " * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or\n"
+        " * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for\n"
+        " * more details.\n"
+        " *\n"
+        " * You should have received a copy of the GNU General Public License\n"
+        " * along with this program.  If not, see <http://www.gnu.org/licenses/>.\n"
+        " */\n";
+
+    std::vector<unsigned char> ReadFile(const char *path) {
+        std::vector<unsigned char> data;
+
+        FILE *f = std::fopen(path, "rb");
+        if (f == nullptr) {
+            return data;
+        }
+
+        std::fseek(f, 0, SEEK_END);
+        data.resize(std::ftell(f));
+        std::fseek(f, 0, SEEK_SET);
+        if (std::fread(data.data(), 1, data.size(), f) != data.size()) {
+            data.clear();
+        }
+        std::fclose(f);
+
+        return data;
+    }
+
+    bool PackAtlas(std::vector<unsigned char> &pixels, int *out_height, stbtt_packedchar (&packed)[FontSizeCount][CodePointCount], const unsigned char *font_data) {
+        for (int height = AtlasWidth / 2; height <= AtlasMaxHeight; height *= 2) {
+            pixels.assign(AtlasWidth * height, 0);
+
+            stbtt_pack_range ranges[FontSizeCount];
+            for (size_t i = 0; i < FontSizeCount; ++i) {
+                ranges[i] = {
+                    .font_size                        = static_cast<float>(FontSizes[i] * 1.375),
+                    .first_unicode_codepoint_in_range = FirstCodePoint,
+                    .array_of_unicode_codepoints      = nullptr,
+                    .num_chars                        = CodePointCount,
+                    .chardata_for_range               = packed[i],
+                    .h_oversample                     = 0,
+                    .v_oversample                     = 0,
+                };
+            }
+
+            stbtt_pack_context pack_context;
+            if (!stbtt_PackBegin(std::addressof(pack_context), pixels.data(), AtlasWidth, height, 0, 1, nullptr)) {
+                return false;
+            }
+
+            const bool success = stbtt_PackFontRanges(std::addressof(pack_context), font_data, 0, ranges, FontSizeCount);
+            stbtt_PackEnd(std::addressof(pack_context));
+
+            if (success) {
+                *out_height = height;
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+}
+
+int main(int argc, char **argv) {
+    if (argc != 3) {
+        std::fprintf(stderr, "Usage: %s <font.ttf> <fatal_font_atlas.inc>\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    /* Load the font. */
+    const auto font_data = ReadFile(argv[1]);
+    stbtt_fontinfo font;
+    if (font_data.empty() || !stbtt_InitFont(std::addressof(font), font_data.data(), stbtt_GetFontOffsetForIndex(font_data.data(), 0))) {
+        std::fprintf(stderr, "Error: failed to load font (%s)\n", argv[1]);
+        return EXIT_FAILURE;
+    }
+
+    /* Pack the atlas. */
+    std::vector<unsigned char> pixels;
+    int height = 0;
+    stbtt_packedchar packed[FontSizeCount][CodePointCount];
+    if (!PackAtlas(pixels, std::addressof(height), packed, font_data.data())) {
+        std::fprintf(stderr, "Error: failed to pack glyph atlas\n");
+        return EXIT_FAILURE;
+    }
+
+    FILE *out = std::fopen(argv[2], "w");
+    if (out == nullptr) {
+        std::fprintf(stderr, "Error: failed to open output (%s)\n", argv[2]);
+        return EXIT_FAILURE;
+    }
+
+    std::fprintf(out, "%s\n", LicenseHeader);
+    std::fprintf(out, "/* Generated by tools/fatal_font_atlas_generator.cpp. Do not edit. */\n\n");
+
+    /* Emit font-wide metrics. */
+    int ascent, descent;
+    stbtt_GetFontVMetrics(std::addressof(font), std::addressof(ascent), std::addressof(descent), nullptr);
+
+    std::fprintf(out, "constexpr size_t CompiledFontAtlasWidth = 0x%X;\n", AtlasWidth);
+    std::fprintf(out, "constexpr size_t CompiledFontAtlasHeight = 0x%X;\n", height);
+    std::fprintf(out, "constexpr s32 CompiledFontAscent = %d;\n", ascent);
+    std::fprintf(out, "constexpr s32 CompiledFontHeight = %d;\n\n", ascent - descent);
+
+    /* Emit per-size metrics. */
+    std::fprintf(out, "static constexpr CompiledFontSize CompiledFontSizes[] = {\n");
+    for (size_t i = 0; i < FontSizeCount; ++i) {
+        const float scale = stbtt_ScaleForPixelHeight(std::addressof(font), FontSizes[i] * 1.375);
+        std::fprintf(out, "    {\n        %af, %af,\n        {\n", FontSizes[i], scale);
+
+        for (int c = 0; c < CodePointCount; ++c) {
+            int adv_width, left_side_bearing;
+            stbtt_GetCodepointHMetrics(std::addressof(font), FirstCodePoint + c, std::addressof(adv_width), std::addressof(left_side_bearing));
+
+            const auto &p = packed[i][c];
+            std::fprintf(out, "            { 0x%02X, 0x%02X, %2d, %2d, %3d, %3d, %5d, %5d },\n", p.x0, p.y0, p.x1 - p.x0, p.y1 - p.y0, static_cast<int>(p.xoff), static_cast<int>(p.yoff), adv_width, left_side_bearing);
+        }
+
+        std::fprintf(out, "        },\n    },\n");
+    }
+    std::fprintf(out, "};\n\n");
+
+    /* Emit kerning pairs, sorted by pair index. */
+    std::fprintf(out, "static constexpr CompiledKerningPair CompiledFontKerningPairs[] = {\n");
+    size_t num_pairs = 0;
+    for (int first = 0; first < CodePointCount; ++first) {
+        for (int second = 0; second < CodePointCount; ++second) {
+            if (const int kern = stbtt_GetCodepointKernAdvance(std::addressof(font), FirstCodePoint + first, FirstCodePoint + second); kern != 0) {
+                std::fprintf(out, "    { 0x%04X, %d },\n", first * CodePointCount + second, kern);
+                ++num_pairs;
+            }
+        }
+    }
+    if (num_pairs == 0) {
+        /* Keep the array non-empty. */
+        std::fprintf(out, "    { 0xFFFF, 0 },\n");
+    }
+    std::fprintf(out, "};\n\n");
+
+    /* Emit the atlas itself. */
+    std::fprintf(out, "static constexpr u8 CompiledFontAtlasData[] = {");
+    for (size_t i = 0; i < pixels.size(); ++i) {
+        std::fprintf(out, "%s0x%02X,", (i % 32) == 0 ? "\n    " : " ", pixels[i]);
+    }
+    std::fprintf(out, "\n};\n\n");
+
+    std::fprintf(out, "static_assert(util::size(CompiledFontSizes) == AtlasFontSizeCount, \"Compiled font definition!\");\n");
+    std::fprintf(out, "static_assert(util::size(CompiledFontAtlasData) == CompiledFontAtlasWidth * CompiledFontAtlasHeight, \"Compiled font definition!\");\n");
+
+    std::fclose(out);
+
+    std::printf("Wrote %s: %dx%d atlas, %zu glyphs, %zu kerning pairs\n", argv[2], AtlasWidth, height, FontSizeCount * CodePointCount, num_pairs);
+    return EXIT_SUCCESS;
+}